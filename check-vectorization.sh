@@ -0,0 +1,109 @@
+#!/bin/sh
+#
+# Usage: check-vectorization.sh OBJDUMP FILE [PREFIX]
+#
+# Disassembles FILE (an object file or archive) and checks every
+# function whose name starts with PREFIX (default fa_vec_). Loops are
+# found from backward branches; a function passes if the body of one
+# of its loops has a packed floating-point arithmetic instruction and
+# no non-temporal store, i.e. the assignment's loop with cached stores
+# is vectorized. Packed instructions outside loop bodies, or only in
+# the streaming loop, do not count. Exits 1 and names the offending
+# kernels otherwise. Exits 77 (skipped) when FILE was not compiled for
+# x86.
+
+OBJDUMP=$1
+shift
+FILE=$1
+shift
+PREFIX=${1:-fa_vec_}
+
+if test ! -r "$FILE"
+then
+	echo "check-vectorization: cannot read $FILE"
+	exit 1
+fi
+
+if ! $OBJDUMP -f "$FILE" | grep -q "architecture: i386"
+then
+	echo "check-vectorization: $FILE is not x86 object code, skipping"
+	exit 77
+fi
+
+$OBJDUMP -d --no-show-raw-insn "$FILE" | awk -v prefix="$PREFIX" '
+function hex(s,    i, c, v) {
+	v = 0
+	s = tolower(s)
+	for (i = 1; i <= length(s); ++i) {
+		c = index("0123456789abcdef", substr(s, i, 1))
+		if (c == 0)
+			break
+		v = v * 16 + c - 1
+	}
+	return v
+}
+function packed(m) {
+	return m ~ /^v?(add|sub|mul|div|max|min|sqrt)p[sd]$/ ||
+	       m ~ /^vf(n?m(add|sub)|maddsub|msubadd)[0-9]*p[sd]$/
+}
+# classifies the loops of the function read so far
+function finish(    l, i, arithmetic, streaming) {
+	if (current == "")
+		return
+	for (l = 1; l <= loops; ++l) {
+		arithmetic = 0
+		streaming = 0
+		for (i = 1; i <= n; ++i) {
+			if (addr[i] < loop_begin[l] || addr[i] > loop_end[l])
+				continue
+			if (packed(mnemonic[i]))
+				arithmetic = 1
+			if (mnemonic[i] ~ /^v?movnt/)
+				streaming = 1
+		}
+		if (arithmetic && !streaming)
+			vectorized[current] = 1
+	}
+	current = ""
+}
+# function header, e.g. "0000000000000000 <fa_vec_add>:"
+/^[0-9a-f]+ <.*>:$/ {
+	finish()
+	name = $2
+	gsub(/[<>:]/, "", name)
+	# skip parts the compiler splits off, e.g. fa_vec_add.cold
+	if (index(name, prefix) == 1 && index(name, ".") == 0) {
+		current = name
+		order[++count] = current
+		n = 0
+		loops = 0
+	}
+	next
+}
+current != "" && $1 ~ /^[0-9a-f]+:$/ {
+	address = hex($1)
+	addr[++n] = address
+	mnemonic[n] = $2
+	# a branch back to an earlier address closes a loop
+	if ($2 ~ /^j/ && $3 ~ /^[0-9a-f]+$/ && hex($3) < address) {
+		loop_begin[++loops] = hex($3)
+		loop_end[loops] = address
+	}
+}
+END {
+	finish()
+	if (count == 0) {
+		print "check-vectorization: no " prefix "* functions found"
+		exit 1
+	}
+	failed = 0
+	for (k = 1; k <= count; ++k) {
+		if (order[k] in vectorized) {
+			print "vectorized:     " order[k]
+		} else {
+			print "NOT vectorized: " order[k]
+			failed = 1
+		}
+	}
+	exit failed
+}'
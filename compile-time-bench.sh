@@ -0,0 +1,70 @@
+#!/bin/sh
+#
+# Usage: compile-time-bench.sh SOURCE_DIR [DEPTHS...]
+#
+# Compile-time cost of expression templates. For each depth, generates
+# a translation unit that assigns an expression nested that many
+# operators deep, compiles it with $CXX (default c++) and $CXXFLAGS
+# (default -std=c++11 -O3), and reports the wall time, the object
+# size, the number of symbols and the length of the longest symbol.
+
+SOURCE_DIR=$1
+shift
+DEPTHS=${*:-"1 2 4 8 16 32 64"}
+CXX=${CXX:-c++}
+CXXFLAGS=${CXXFLAGS:-"-std=c++11 -O3"}
+NM=${NM:-nm}
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+now() {
+	date +%s.%N
+}
+
+# expression nested DEPTH binary operators deep, with a math
+# function every fourth level
+expression() {
+	awk -v depth="$1" 'BEGIN {
+		split("+ * - /", ops, " ")
+		split("a b c d", arrays, " ")
+		e = "a"
+		for (k = 1; k <= depth; ++k) {
+			e = "(" e " " ops[(k - 1) % 4 + 1] " " arrays[k % 4 + 1] ")"
+			if (k % 4 == 0)
+				e = "sqrt(" e ")"
+		}
+		print e
+	}'
+}
+
+printf "%6s %10s %12s %8s %12s\n" depth seconds object symbols "max symbol"
+for DEPTH in $DEPTHS
+do
+	TU="$WORK/depth$DEPTH.cpp"
+	EXPR=$(expression "$DEPTH")
+	cat > "$TU" <<EOF
+#include <FastArray.hpp>
+void kernel(fa::FastArray& out, const fa::FastArray& a,
+            const fa::FastArray& b, const fa::FastArray& c,
+            const fa::FastArray& d) {
+  out = $EXPR;
+  out += $EXPR;
+}
+EOF
+	START=$(now)
+	if ! $CXX $CXXFLAGS -I"$SOURCE_DIR/src" -c "$TU" -o "$WORK/depth$DEPTH.o"
+	then
+		echo "compile-time-bench: depth $DEPTH failed to compile"
+		exit 1
+	fi
+	END=$(now)
+	OBJECT=$(wc -c < "$WORK/depth$DEPTH.o")
+	$NM "$WORK/depth$DEPTH.o" | awk '{ print $NF }' > "$WORK/symbols"
+	SYMBOLS=$(wc -l < "$WORK/symbols")
+	LONGEST=$(awk '{ if (length($0) > n) n = length($0) } END { print n + 0 }' \
+	          "$WORK/symbols")
+	awk -v d="$DEPTH" -v s="$START" -v e="$END" -v o="$OBJECT" \
+	    -v n="$SYMBOLS" -v l="$LONGEST" \
+	    'BEGIN { printf "%6d %10.3f %12d %8d %12d\n", d, e - s, o, n, l }'
+done
@@ -2,8 +2,82 @@
 #ifndef SRC_FASTARRAY_HPP_
 #define SRC_FASTARRAY_HPP_
 
+#include <stdint.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+// Optional per-expression instrumentation of whole-array evaluation,
+// see fa_perf.hpp and fa_profile.hpp. KEY is a type identifying the
+// evaluation, LABEL the kind of assignment and SIGNATURE a function
+// returning the readable expression signature.
+#if defined(FA_PERF_COUNTERS)
+#include <fa_perf.hpp>
+#define FA_PERF_SCOPE(KEY, ELEMENTS) \
+  fa::perf::ScopedMeasurement fa_perf_measurement(typeid(KEY), ELEMENTS);
+#define FA_PERF_PARALLEL_SCOPE(KEY, ELEMENTS) \
+  fa::perf::ParallelMeasurement fa_perf_parallel(typeid(KEY), ELEMENTS);
+#define FA_PERF_PART_SCOPE() \
+  fa::perf::ParallelMeasurement::Part fa_perf_part(fa_perf_parallel);
+#else
+#define FA_PERF_SCOPE(KEY, ELEMENTS)
+#define FA_PERF_PARALLEL_SCOPE(KEY, ELEMENTS)
+#define FA_PERF_PART_SCOPE()
+#endif
+#if defined(FA_PROFILE)
+#include <fa_profile.hpp>
+#define FA_PROFILE_SCOPE(KEY, LABEL, SIGNATURE, ELEMENTS) \
+  fa::profile::ScopedTimer fa_profile_timer(typeid(KEY), LABEL, \
+                                            SIGNATURE, ELEMENTS);
+#else
+#define FA_PROFILE_SCOPE(KEY, LABEL, SIGNATURE, ELEMENTS)
+#endif
+// The profile scope is outermost so that its bookkeeping (a lock, a
+// lookup, and on first use building the signature) stays outside the
+// hardware-counter window.
+#define FA_INSTRUMENT(KEY, LABEL, SIGNATURE, ELEMENTS) \
+  FA_PROFILE_SCOPE(KEY, LABEL, SIGNATURE, ELEMENTS) \
+  FA_PERF_SCOPE(KEY, ELEMENTS)
+// For evaluations split between threads: each thread's part opens
+// FA_INSTRUMENT_PART() and the counts of all parts are recorded
+#define FA_INSTRUMENT_PARALLEL(KEY, LABEL, SIGNATURE, ELEMENTS) \
+  FA_PROFILE_SCOPE(KEY, LABEL, SIGNATURE, ELEMENTS) \
+  FA_PERF_PARALLEL_SCOPE(KEY, ELEMENTS)
+#define FA_INSTRUMENT_PART() FA_PERF_PART_SCOPE()
+
+// Optional allocation, reallocation and copy counters, see fa_alloc.hpp
+#if defined(FA_ALLOCATION_COUNTERS)
+#include <fa_alloc.hpp>
+#define FA_COUNT_ALLOCATE(BYTES, REPLACES) \
+  fa::alloc::on_allocate(BYTES, REPLACES);
+#define FA_COUNT_DEALLOCATE(BYTES) fa::alloc::on_deallocate(BYTES);
+#define FA_COUNT_COPY() fa::alloc::on_copy();
+#else
+#define FA_COUNT_ALLOCATE(BYTES, REPLACES)
+#define FA_COUNT_DEALLOCATE(BYTES)
+#define FA_COUNT_COPY()
+#endif
+
+// Restrict qualifier for the non-aliased evaluation loops
+#if defined(_MSC_VER)
+#define FA_RESTRICT __restrict
+#else
+#define FA_RESTRICT __restrict__
+#endif
 
 namespace fa {
 typedef double ScalarT;
@@ -41,6 +115,127 @@ FA_PROMOTE(float, long, float);
 FA_PROMOTE(float, unsigned, float);
 #undef FA_PROMOTE
 
+//
+// Type promotion over any number of types
+//
+template <class T, class... Rest>
+struct promote_all {
+  typedef typename promote<T, typename promote_all<Rest...>::type>::type type;
+};
+
+template <class T>
+struct promote_all<T> {
+  typedef T type;
+};
+
+//
+// Compile-time index sequence -- helper for expanding
+// the operand tuple of variadic nodes
+//
+template <int... N>
+struct indices {};
+
+template <int I, int... N>
+struct make_indices : make_indices<I - 1, I - 1, N...> {};
+
+template <int... N>
+struct make_indices<0, N...> {
+  typedef indices<N...> type;
+};
+
+//
+// Memory overlap test for the half-open ranges [b1, e1) and [b2, e2)
+//
+inline bool overlaps(const ScalarT* b1, const ScalarT* e1,
+                     const ScalarT* b2, const ScalarT* e2) {
+  std::less<const ScalarT*> lt;
+  return lt(b1, e2) && lt(b2, e1);
+}
+
+//
+// Expression signatures -- every term<> can describe itself as a
+// readable string such as log10(exp(A)+cos(B)*pow(C,s)/(-D+s)).
+// Arrays are named A, B, C, ... in order of appearance and scalars
+// are shown as s. Precedences decide where parentheses are needed.
+//
+enum {
+  PRECEDENCE_ADDITIVE = 1,
+  PRECEDENCE_MULTIPLICATIVE = 2,
+  PRECEDENCE_UNARY = 3,
+  PRECEDENCE_ATOM = 4
+};
+
+typedef void (*Describer)(std::string* out, int* next_array);
+
+// "operator+" -> "+", "pow" -> 0
+inline const char* operator_symbol(const char* name) {
+  static const char prefix[] = "operator";
+  const size_t length = sizeof(prefix) - 1;
+  return std::strncmp(name, prefix, length) == 0 ? name + length : 0;
+}
+
+// "operator+" -> PRECEDENCE_ADDITIVE, "pow" -> PRECEDENCE_ATOM
+inline int operator_precedence(const char* name, const bool unary) {
+  const char* symbol = operator_symbol(name);
+  if (symbol == 0)
+    return PRECEDENCE_ATOM;
+  if (unary)
+    return PRECEDENCE_UNARY;
+  return *symbol == '+' || *symbol == '-' ? PRECEDENCE_ADDITIVE
+                                          : PRECEDENCE_MULTIPLICATIVE;
+}
+
+inline void describe_operand(Describer operand, const bool parenthesize,
+                             std::string* out, int* next_array) {
+  if (parenthesize)
+    out->append("(");
+  operand(out, next_array);
+  if (parenthesize)
+    out->append(")");
+}
+
+inline void describe_binary(const char* name,
+                            Describer left, const int left_precedence,
+                            Describer right, const int right_precedence,
+                            std::string* out, int* next_array) {
+  const int precedence = operator_precedence(name, false);
+  if (precedence == PRECEDENCE_ATOM) {
+    out->append(name).append("(");
+    left(out, next_array);
+    out->append(",");
+    right(out, next_array);
+    out->append(")");
+    return;
+  }
+  // left-associative: only the right operand needs parentheses
+  // at equal precedence, as in A-(B+C)
+  describe_operand(left, left_precedence < precedence, out, next_array);
+  out->append(operator_symbol(name));
+  describe_operand(right, right_precedence <= precedence, out, next_array);
+}
+
+inline void describe_unary(const char* name,
+                           Describer operand, const int operand_precedence,
+                           std::string* out, int* next_array) {
+  const int precedence = operator_precedence(name, true);
+  if (precedence == PRECEDENCE_ATOM) {
+    out->append(name);
+    describe_operand(operand, true, out, next_array);
+    return;
+  }
+  out->append(operator_symbol(name));
+  describe_operand(operand, operand_precedence < precedence,
+                   out, next_array);
+}
+
+inline void describe_array(std::string* out, int* next_array) {
+  const int n = (*next_array)++;
+  if (n < 26)
+    out->append(1, static_cast<char>('A' + n));
+  else
+    out->append("A").append(std::to_string(n));
+}
+
 //
 // Term wrapper -- helper template that allows
 // POD types, FastArrays and Expression Templates
@@ -57,9 +252,273 @@ struct term {
     return m_t[i];
   }
 
+  // unknown operand types are assumed to alias any range
+  bool aliases(const ScalarT*, const ScalarT*) const {
+    return true;
+  }
+
+  bool shifted(const ScalarT*, const ScalarT*) const {
+    return true;
+  }
+
+  static int precedence() {
+    return PRECEDENCE_ATOM;
+  }
+
+  static void describe(std::string* out, int*) {
+    out->append("?");
+  }
+
+  static int arrays() {
+    return 1;
+  }
+
+  static int flops() {
+    return 0;
+  }
+
   const T& m_t;
 };
 
+//
+// Nested term wrapper -- a term<> of an expression holds the
+// expression by value, so that an expression can safely outlive
+// the statement that built it
+//
+template <class T>
+struct term<term<T> > : term<T> {
+  // implicit constructor
+  term(const term<T>& t) : term<T>(t) {}  // NOLINT(runtime/explicit)
+};
+
+//
+// Operand type -- the type an expression node records for an
+// operand: FastArray, a scalar, or the node type of a nested
+// expression with its term<> unwrapped. Node types therefore nest
+// as addition<mulitiplication<FastArray, double>, FastArray> rather
+// than through a term<term<...> > at every level, which keeps
+// instantiation depth and symbol length down.
+//
+template <class T>
+struct operand {
+  typedef T type;
+};
+
+template <class T>
+struct operand<term<T> > {
+  typedef T type;
+};
+
+// Readable signature of the expression type T
+template <class T>
+inline std::string signature() {
+  std::string out;
+  int next_array = 0;
+  term<T>::describe(&out, &next_array);
+  return out;
+}
+
+template <class T>
+inline std::string signature(const T&) {
+  return signature<T>();
+}
+
+//
+// Nominal per-element cost of an expression -- the number of array
+// operands it reads (an array used twice counts twice) and its
+// floating-point operation count
+//
+struct cost {
+  int arrays;
+  int flops;
+};
+
+template <class T>
+inline cost expression_cost(const T&) {
+  const cost c = { term<T>::arrays(), term<T>::flops() };
+  return c;
+}
+
+//
+// Assignment operators -- applied element-wise by the
+// FastArray evaluation loops
+//
+struct assign_op {
+  static const char* symbol() { return "="; }
+  static void apply(ScalarT& x, const ScalarT y) { x = y; }
+};
+struct plus_assign_op {
+  static const char* symbol() { return "+="; }
+  static void apply(ScalarT& x, const ScalarT y) { x += y; }
+};
+struct minus_assign_op {
+  static const char* symbol() { return "-="; }
+  static void apply(ScalarT& x, const ScalarT y) { x -= y; }
+};
+struct multiply_assign_op {
+  static const char* symbol() { return "*="; }
+  static void apply(ScalarT& x, const ScalarT y) { x *= y; }
+};
+struct divide_assign_op {
+  static const char* symbol() { return "/="; }
+  static void apply(ScalarT& x, const ScalarT y) { x /= y; }
+};
+
+//
+// Evaluation loops -- x[i] op= rhs[i] for i in [begin, end). The
+// restrict-qualified loop may only be used when the destination
+// does not overlap any operand of rhs.
+//
+template <class Op, class T>
+inline void evaluate_loop(ScalarT* x, const IndexT begin, const IndexT end,
+                          const term<T>& rhs) {
+  for (IndexT i = begin; i < end; ++i)
+    Op::apply(x[i], rhs[i]);
+}
+
+template <class Op, class T>
+inline void evaluate_loop_restrict(ScalarT* FA_RESTRICT x,
+                                   const IndexT begin, const IndexT end,
+                                   const term<T>& rhs) {
+  for (IndexT i = begin; i < end; ++i)
+    Op::apply(x[i], rhs[i]);
+}
+
+//
+// Streaming stores -- x[i] = rhs[i] for i in [begin, end) using
+// non-temporal stores, which write around the cache and avoid the
+// read-for-ownership of the destination. Values are computed one
+// cache line at a time and stored as full, aligned lines. Falls
+// back to the restrict loop when the target has no streaming
+// stores. Like evaluate_loop_restrict, requires that x does not
+// overlap any operand of rhs.
+//
+template <class T>
+inline void evaluate_loop_streaming(ScalarT* FA_RESTRICT x,
+                                    const IndexT begin, const IndexT end,
+                                    const term<T>& rhs) {
+#if defined(__AVX__) || defined(__SSE2__)
+  const IndexT line = 64 / sizeof(ScalarT);
+  IndexT i = begin;
+  for (; i < end && reinterpret_cast<uintptr_t>(x + i) % 64 != 0; ++i)
+    x[i] = rhs[i];
+  for (; i + line <= end; i += line) {
+    ScalarT buf[line];
+    for (IndexT k = 0; k < line; ++k)
+      buf[k] = rhs[i + k];
+#if defined(__AVX__)
+    for (IndexT k = 0; k < line; k += 4)
+      _mm256_stream_pd(x + i + k, _mm256_loadu_pd(buf + k));
+#else
+    for (IndexT k = 0; k < line; k += 2)
+      _mm_stream_pd(x + i + k, _mm_loadu_pd(buf + k));
+#endif
+  }
+  for (; i < end; ++i)
+    x[i] = rhs[i];
+  _mm_sfence();
+#else
+  evaluate_loop_restrict<assign_op>(x, begin, end, rhs);
+#endif
+}
+
+//
+// Streaming threshold -- plain assignments to arrays of at least
+// this many bytes use streaming stores. Defaults to the size of
+// the last-level cache: a destination that large would only evict
+// the operands on its way through the cache.
+//
+inline size_t detect_llc_size() {
+#if defined(_SC_LEVEL3_CACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+  const long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);  // NOLINT(runtime/int)
+  if (l3 > 0)
+    return static_cast<size_t>(l3);
+  const long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);  // NOLINT(runtime/int)
+  if (l2 > 0)
+    return static_cast<size_t>(l2);
+#endif
+  return 8 << 20;
+}
+
+// Read by every evaluation, including inside parallel regions, while
+// another thread may set it, so it is a relaxed atomic
+inline std::atomic<size_t>& streaming_threshold_storage() {
+  static std::atomic<size_t> threshold(detect_llc_size());
+  return threshold;
+}
+
+inline size_t streaming_threshold() {
+  return streaming_threshold_storage().load(std::memory_order_relaxed);
+}
+
+// Pass 0 to always stream, std::numeric_limits<size_t>::max() to never
+inline void set_streaming_threshold(const size_t bytes) {
+  streaming_threshold_storage().store(bytes, std::memory_order_relaxed);
+}
+
+//
+// Allocator - where a FastArray keeps its elements. FastArrays
+// allocate with new[] unless given another allocator, e.g. one that
+// places them in shared memory (fa_shm.hpp). An allocator is not owned
+// by the arrays using it and must outlive them.
+//
+class Allocator {
+ public:
+  virtual ~Allocator() {}
+  // storage for n > 0 elements, not initialized; throws on failure
+  virtual ScalarT* allocate(const IndexT n) = 0;
+  // p and n as returned by and given to allocate()
+  virtual void deallocate(ScalarT* p, const IndexT n) = 0;
+
+  // Copy-on-write (fa_cow.hpp). An allocator that counts references
+  // to its buffers lets copies of its arrays share them until either
+  // writes; the others keep these defaults.
+  virtual bool counts_references() const {
+    return false;
+  }
+  virtual void add_reference(ScalarT*) {}
+  // true if p has references besides the caller's
+  virtual bool is_shared(const ScalarT*) const {
+    return false;
+  }
+  // Drops a reference to p, returning true if that freed it
+  virtual bool release(ScalarT* p, const IndexT n) {
+    deallocate(p, n);
+    return true;
+  }
+};
+
+class new_allocator : public Allocator {
+ public:
+  ScalarT* allocate(const IndexT n) {
+    return new ScalarT[n];
+  }
+  void deallocate(ScalarT* p, const IndexT) {
+    delete[] p;
+  }
+};
+
+inline Allocator* heap_allocator() {
+  static new_allocator allocator;
+  return &allocator;
+}
+
+inline Allocator*& default_allocator_storage() {
+  static Allocator* allocator = heap_allocator();
+  return allocator;
+}
+
+// The allocator of arrays constructed without one, and of copies
+inline Allocator* default_allocator() {
+  return default_allocator_storage();
+}
+
+// Arrays keep the allocator they were constructed with, so this only
+// affects arrays constructed afterwards; e.g. fa::pool::allocator()
+// (fa_pool.hpp) recycles buffers of recurring sizes
+inline void set_default_allocator(Allocator* allocator) {
+  default_allocator_storage() = allocator;
+}
 
 //
 // FastArray - array class with Expression Template
@@ -71,30 +530,77 @@ struct FastArray {
   FastArray()
     : m_x(0),
       m_size(0),
-      m_capacity(0) {}
+      m_capacity(0),
+      m_allocator(default_allocator()),
+      m_copy_on_write(m_allocator->counts_references()) {}
+
+  explicit FastArray(Allocator* allocator)
+    : m_x(0),
+      m_size(0),
+      m_capacity(0),
+      m_allocator(allocator),
+      m_copy_on_write(allocator->counts_references()) {}
 
   explicit FastArray(const IndexT initial_size)
     : m_x(0),
       m_size(0),
-      m_capacity(0) {
+      m_capacity(0),
+      m_allocator(default_allocator()),
+      m_copy_on_write(m_allocator->counts_references()) {
     resize(initial_size);
     // not initialized for efficiency
   }
 
+  FastArray(const IndexT initial_size, Allocator* allocator)
+    : m_x(0),
+      m_size(0),
+      m_capacity(0),
+      m_allocator(allocator),
+      m_copy_on_write(allocator->counts_references()) {
+    resize(initial_size);
+  }
+
   FastArray(
       const IndexT initial_size,
       const ScalarT val)
     : m_x(0),
       m_size(0),
-      m_capacity(0) {
+      m_capacity(0),
+      m_allocator(default_allocator()),
+      m_copy_on_write(m_allocator->counts_references()) {
+    resize(initial_size);
+    set_all(val);
+  }
+
+  // An integer value, e.g. FastArray(n, 0), which would otherwise be
+  // ambiguous with the allocator overload since 0 is a null pointer
+  FastArray(const IndexT initial_size, const int val)
+    : m_x(0),
+      m_size(0),
+      m_capacity(0),
+      m_allocator(default_allocator()),
+      m_copy_on_write(m_allocator->counts_references()) {
     resize(initial_size);
     set_all(val);
   }
 
+  // Copies are private to the copier, so they use the default
+  // allocator; assignment keeps the target's allocator. Copies of
+  // copy-on-write arrays share the buffer instead, in O(1), as does
+  // assignment between arrays of the same copy-on-write allocator.
   FastArray(const FastArray& other)
     : m_x(0),
       m_size(0),
-      m_capacity(0) {
+      m_capacity(0),
+      m_allocator(default_allocator()),
+      m_copy_on_write(m_allocator->counts_references()) {
+    if (other.m_copy_on_write && other.m_x != 0) {
+      m_allocator = other.m_allocator;
+      m_copy_on_write = true;
+      share(other);
+      return;
+    }
+    FA_COUNT_COPY()
     resize(other.size());
     for (IndexT i = 0; i < m_size; ++i)
       m_x[i] = other.m_x[i];
@@ -103,6 +609,19 @@ struct FastArray {
   FastArray& operator=(const FastArray& other) {
     if (this == &other)
       return *this;
+    if (m_copy_on_write && other.m_allocator == m_allocator &&
+        other.m_x != 0) {
+      if (m_x != other.m_x) {
+        release();
+        share(other);
+      }
+      m_size = other.m_size;
+      return *this;
+    }
+    FA_COUNT_COPY()
+    // the elements are all overwritten, so a shared buffer is dropped
+    if (shared())
+      release();
     resize(other.size());
     for (IndexT i = 0; i < m_size; ++i)
       m_x[i] = other.m_x[i];
@@ -110,7 +629,7 @@ struct FastArray {
   }
 
   ~FastArray() {
-    if (m_x != 0) delete[] m_x;
+    release();
   }
 
   void resize(const IndexT new_size) {
@@ -120,15 +639,19 @@ struct FastArray {
       return;
     }
     // if we're here, then m_capacity (and m_size) < new_size
-    if (m_x != 0)
-      delete[] m_x;
+    const bool replaces = m_x != 0;
+    if (replaces)
+      release();
+    m_x = m_allocator->allocate(new_size);
     m_size = new_size;
     m_capacity = new_size;
-    m_x = new ScalarT[m_capacity];
+    FA_COUNT_ALLOCATE(m_capacity * sizeof(ScalarT), replaces)
     // not initialized for efficiency
   }
 
   void set_all(const ScalarT& value) {
+    if (m_copy_on_write)
+      detach(false);
     for (IndexT i = 0; i < m_size; ++i)
       m_x[i] = value;
   }
@@ -140,40 +663,82 @@ struct FastArray {
 
   template <class T>
   FastArray& operator=(const term<T>& rhs) {
-    for (IndexT i = 0; i < m_size; ++i)
-      m_x[i] = rhs[i];
+    FA_INSTRUMENT(assign_op(term<T>), assign_op::symbol(), &signature<T>,
+                  m_size);
+    // every element is overwritten: unless rhs reads them, a shared
+    // buffer need not be copied
+    if (m_copy_on_write)
+      detach(rhs.aliases(m_x, m_x + m_size));
+    if (m_size * sizeof(ScalarT) >= streaming_threshold())
+      stream(rhs, 0, m_size);
+    else
+      evaluate<assign_op>(rhs, 0, m_size);
     return *this;
   }
 
   template <class T>
   FastArray& operator+=(const term<T>& rhs) {
-    for (IndexT i = 0; i < m_size; ++i)
-      m_x[i] += rhs[i];
+    FA_INSTRUMENT(plus_assign_op(term<T>), plus_assign_op::symbol(),
+                  &signature<T>, m_size);
+    evaluate<plus_assign_op>(rhs, 0, m_size);
     return *this;
   }
 
   template <class T>
   FastArray& operator-=(const term<T>& rhs) {
-    for (IndexT i = 0; i < m_size; ++i)
-      m_x[i] -= rhs[i];
+    FA_INSTRUMENT(minus_assign_op(term<T>), minus_assign_op::symbol(),
+                  &signature<T>, m_size);
+    evaluate<minus_assign_op>(rhs, 0, m_size);
     return *this;
   }
 
   template <class T>
   FastArray& operator*=(const term<T>& rhs) {
-    for (IndexT i = 0; i < m_size; ++i)
-      m_x[i] *= rhs[i];
+    FA_INSTRUMENT(multiply_assign_op(term<T>), multiply_assign_op::symbol(),
+                  &signature<T>, m_size);
+    evaluate<multiply_assign_op>(rhs, 0, m_size);
     return *this;
   }
 
   template <class T>
   FastArray& operator/=(const term<T>& rhs) {
-    for (IndexT i = 0; i < m_size; ++i)
-      m_x[i] /= rhs[i];
+    FA_INSTRUMENT(divide_assign_op(term<T>), divide_assign_op::symbol(),
+                  &signature<T>, m_size);
+    evaluate<divide_assign_op>(rhs, 0, m_size);
     return *this;
   }
 
+  // Evaluates (*this)[i] op= rhs[i] for i in [begin, end), using
+  // the restrict-qualified loop when rhs does not read this array
+  template <class Op, class T>
+  void evaluate(const term<T>& rhs, const IndexT begin, const IndexT end) {
+    if (m_copy_on_write)
+      detach(true);
+    if (rhs.aliases(m_x + begin, m_x + end))
+      evaluate_loop<Op>(m_x, begin, end, rhs);
+    else
+      evaluate_loop_restrict<Op>(m_x, begin, end, rhs);
+  }
+
+  // Assigns (*this)[i] = rhs[i] for i in [begin, end) with
+  // streaming stores, unless rhs reads this array
+  template <class T>
+  void stream(const term<T>& rhs, const IndexT begin, const IndexT end) {
+    if (m_copy_on_write)
+      detach(true);
+    if (rhs.aliases(m_x + begin, m_x + end))
+      evaluate_loop<assign_op>(m_x, begin, end, rhs);
+    else
+      evaluate_loop_streaming(m_x, begin, end, rhs);
+  }
+
+  // Non-const access counts as a write: a copy-on-write array that
+  // shares its buffer gets its own first. The reference, like the
+  // pointer from data(), must not be kept across a copy of the
+  // array, which would share the buffer it writes
   ScalarT& operator[](const IndexT i) {
+    if (m_copy_on_write)
+      detach(true);
     return m_x[i];
   }
 
@@ -189,10 +754,77 @@ struct FastArray {
     return m_capacity;
   }
 
+  ScalarT* data() {
+    if (m_copy_on_write)
+      detach(true);
+    return m_x;
+  }
+
+  const ScalarT* data() const {
+    return m_x;
+  }
+
+  Allocator* allocator() const {
+    return m_allocator;
+  }
+
+  // True if this copy-on-write array shares its buffer
+  bool shared() const {
+    return m_copy_on_write && m_x != 0 && m_allocator->is_shared(m_x);
+  }
+
+  // Gives a copy-on-write array its own buffer now rather than at the
+  // first write, e.g. before threads write parts of it
+  void unshare() {
+    if (m_copy_on_write)
+      detach(true);
+  }
+
  private:
+  void share(const FastArray& other) {
+    m_allocator->add_reference(other.m_x);
+    m_x = other.m_x;
+    m_size = other.m_size;
+    m_capacity = other.m_capacity;
+  }
+
+  void release() {
+    if (m_x == 0)
+      return;
+    if (m_allocator->release(m_x, m_capacity)) {
+      FA_COUNT_DEALLOCATE(m_capacity * sizeof(ScalarT))
+    }
+    m_x = 0;
+    m_size = 0;
+    m_capacity = 0;
+  }
+
+  // Moves a shared buffer's elements to a buffer of this array's own,
+  // or leaves them uninitialized if !keep
+  void detach(const bool keep) {
+    if (m_x == 0 || !m_allocator->is_shared(m_x))
+      return;
+    const IndexT n = m_size;
+    ScalarT* x = n == 0 ? 0 : m_allocator->allocate(n);
+    if (n != 0) {
+      FA_COUNT_ALLOCATE(n * sizeof(ScalarT), false)
+    }
+    if (keep && n != 0) {
+      FA_COUNT_COPY()
+    }
+    for (IndexT i = 0; keep && i < n; ++i)
+      x[i] = m_x[i];
+    release();
+    m_x = x;
+    m_size = n;
+    m_capacity = n;
+  }
+
   ScalarT* m_x;
   IndexT m_size;
   IndexT m_capacity;
+  Allocator* m_allocator;
+  bool m_copy_on_write;  // m_allocator counts references
 };
 
 template <>
@@ -206,9 +838,113 @@ struct term<FastArray> {
     return m_fa[i];
   }
 
+  bool aliases(const ScalarT* begin, const ScalarT* end) const {
+    return overlaps(begin, end, m_fa.data(), m_fa.data() + m_fa.size());
+  }
+
+  // True if element i of this operand overlaps [begin, end) somewhere
+  // other than at begin + i, i.e. it reads the range out of step
+  bool shifted(const ScalarT* begin, const ScalarT* end) const {
+    return aliases(begin, end) &&
+           (m_fa.data() != begin || m_fa.data() + m_fa.size() != end);
+  }
+
+  static int precedence() {
+    return PRECEDENCE_ATOM;
+  }
+
+  static void describe(std::string* out, int* next_array) {
+    describe_array(out, next_array);
+  }
+
+  static int arrays() {
+    return 1;
+  }
+
+  static int flops() {
+    return 0;
+  }
+
   const FastArray& m_fa;
 };
 
+//
+// FastArrayView - read-only view of contiguous scalars owned
+// elsewhere, e.g. a memory-mapped file. Usable as an operand
+// anywhere a FastArray is; the viewed memory must outlive it.
+//
+struct FastArrayView {
+  typedef ScalarT ValueT;
+
+  FastArrayView()
+    : m_x(0),
+      m_size(0) {}
+
+  FastArrayView(const ScalarT* x, const IndexT size)
+    : m_x(x),
+      m_size(size) {}
+
+  // implicit view of a whole FastArray
+  FastArrayView(const FastArray& fa)  // NOLINT(runtime/explicit)
+    : m_x(fa.data()),
+      m_size(fa.size()) {}
+
+  const ScalarT& operator[](const IndexT i) const {
+    return m_x[i];
+  }
+
+  IndexT size() const {
+    return m_size;
+  }
+
+  const ScalarT* data() const {
+    return m_x;
+  }
+
+ private:
+  const ScalarT* m_x;
+  IndexT m_size;
+};
+
+template <>
+struct term<FastArrayView> {
+  typedef term<FastArrayView> TermT;
+  typedef ScalarT ValueT;
+  // implicit constructor; views are held by value
+  term(const FastArrayView& v) : m_v(v) {}  // NOLINT(runtime/explicit)
+
+  const ScalarT& operator[](const IndexT i) const {
+    return m_v[i];
+  }
+
+  bool aliases(const ScalarT* begin, const ScalarT* end) const {
+    return overlaps(begin, end, m_v.data(), m_v.data() + m_v.size());
+  }
+
+  bool shifted(const ScalarT* begin, const ScalarT* end) const {
+    return aliases(begin, end) &&
+           (m_v.data() != begin || m_v.data() + m_v.size() != end);
+  }
+
+  static int precedence() {
+    return PRECEDENCE_ATOM;
+  }
+
+  static void describe(std::string* out, int* next_array) {
+    describe_array(out, next_array);
+  }
+
+  static int arrays() {
+    return 1;
+  }
+
+  static int flops() {
+    return 0;
+  }
+
+  const FastArrayView m_v;
+};
+
 template <>
 struct term<ScalarT> {
   typedef term<ScalarT> TermT;
@@ -220,15 +956,39 @@ struct term<ScalarT> {
     return m_c;
   }
 
+  bool aliases(const ScalarT*, const ScalarT*) const {
+    return false;
+  }
+
+  bool shifted(const ScalarT*, const ScalarT*) const {
+    return false;
+  }
+
+  static int precedence() {
+    return PRECEDENCE_ATOM;
+  }
+
+  static void describe(std::string* out, int*) {
+    out->append("s");
+  }
+
+  static int arrays() {
+    return 0;
+  }
+
+  static int flops() {
+    return 0;
+  }
+
   const ScalarT m_c;
 };
 
-#define FA_BINARY_OP(LABEL, OPERATOR, EXPR) \
+#define FA_BINARY_OP(LABEL, OPERATOR, FLOPS, EXPR) \
   template <class L, class R> \
   struct LABEL {}; \
 \
   template <class L, class R> \
-  struct term<LABEL<term<L>, term<R> > > { \
+  struct term<LABEL<L, R> > { \
     typedef term<L> TermL; \
     typedef term<R> TermR; \
     typedef typename TermL::ValueT ValueTL; \
@@ -240,33 +1000,57 @@ struct term<ScalarT> {
     ValueT operator[](const IndexT i) const { \
       return EXPR; \
     } \
+    bool aliases(const ScalarT* begin, const ScalarT* end) const { \
+      return m_left.aliases(begin, end) || m_right.aliases(begin, end); \
+    } \
+    bool shifted(const ScalarT* begin, const ScalarT* end) const { \
+      return m_left.shifted(begin, end) || m_right.shifted(begin, end); \
+    } \
+    static int precedence() { \
+      return operator_precedence(#OPERATOR, false); \
+    } \
+    static void describe(std::string* out, int* next_array) { \
+      describe_binary(#OPERATOR, &TermL::describe, TermL::precedence(), \
+                      &TermR::describe, TermR::precedence(), \
+                      out, next_array); \
+    } \
+    static int arrays() { \
+      return TermL::arrays() + TermR::arrays(); \
+    } \
+    static int flops() { \
+      return FLOPS + TermL::flops() + TermR::flops(); \
+    } \
     const term<L> m_left; \
     const term<R> m_right; \
   }; \
 \
   template <class L, class R> \
-  inline term<LABEL<term<L>, term<R> > > \
+  inline term<LABEL<typename operand<L>::type, typename operand<R>::type> > \
   OPERATOR(const L &left, const R &right) { \
-    typedef LABEL<term<L>, term<R> > TermT; \
+    typedef LABEL<typename operand<L>::type, \
+                  typename operand<R>::type> TermT; \
     return term<TermT>(left, right); \
   }
 
-FA_BINARY_OP(addition,       operator+, m_left[i] + m_right[i]);
-FA_BINARY_OP(subtraction,    operator-, m_left[i] - m_right[i]);
-FA_BINARY_OP(mulitiplication, operator*, m_left[i] * m_right[i]);
-FA_BINARY_OP(division,       operator/, m_left[i] / m_right[i]);
-FA_BINARY_OP(math_pow,       pow, std::pow(m_left[i], m_right[i]));
-FA_BINARY_OP(math_max,       max, std::max(m_left[i], m_right[i]));
-FA_BINARY_OP(math_min,       min, std::min(m_left[i], m_right[i]));
-FA_BINARY_OP(math_atan2,     atan2, std::atan2(m_left[i], m_right[i]));
+// FLOPS is the nominal floating-point operation count of one
+// element; library functions are weighted by a rough estimate of
+// their cost in arithmetic operations
+FA_BINARY_OP(addition,       operator+, 1, m_left[i] + m_right[i]);
+FA_BINARY_OP(subtraction,    operator-, 1, m_left[i] - m_right[i]);
+FA_BINARY_OP(mulitiplication, operator*, 1, m_left[i] * m_right[i]);
+FA_BINARY_OP(division,       operator/, 1, m_left[i] / m_right[i]);
+FA_BINARY_OP(math_pow,       pow, 50, std::pow(m_left[i], m_right[i]));
+FA_BINARY_OP(math_max,       max, 1, std::max(m_left[i], m_right[i]));
+FA_BINARY_OP(math_min,       min, 1, std::min(m_left[i], m_right[i]));
+FA_BINARY_OP(math_atan2,     atan2, 40, std::atan2(m_left[i], m_right[i]));
 #undef FA_BINARY_OP
 
-#define FA_UNARY_OP(LABEL, OPERATOR, EXPR) \
+#define FA_UNARY_OP(LABEL, OPERATOR, FLOPS, EXPR) \
   template <class T> \
   struct LABEL {}; \
   \
   template <class T> \
-  struct term<LABEL<term<T> > > { \
+  struct term<LABEL<T> > { \
     typedef term<T> TermT; \
     typedef typename TermT::ValueT ValueT; \
     /* implicit constructor */ \
@@ -274,34 +1058,203 @@ FA_BINARY_OP(math_atan2,     atan2, std::atan2(m_left[i], m_right[i]));
     ValueT operator[](const IndexT i) const { \
       return EXPR; \
     } \
+    bool aliases(const ScalarT* begin, const ScalarT* end) const { \
+      return m_t.aliases(begin, end); \
+    } \
+    bool shifted(const ScalarT* begin, const ScalarT* end) const { \
+      return m_t.shifted(begin, end); \
+    } \
+    static int precedence() { \
+      return operator_precedence(#OPERATOR, true); \
+    } \
+    static void describe(std::string* out, int* next_array) { \
+      describe_unary(#OPERATOR, &TermT::describe, TermT::precedence(), \
+                     out, next_array); \
+    } \
+    static int arrays() { \
+      return TermT::arrays(); \
+    } \
+    static int flops() { \
+      return FLOPS + TermT::flops(); \
+    } \
     const term<T> m_t; \
   }; \
   \
   template <class T> \
-  inline term<LABEL<term<T> > > \
+  inline term<LABEL<typename operand<T>::type> > \
   OPERATOR(const T &t) { \
-    typedef LABEL<term<T> > TermT; \
+    typedef LABEL<typename operand<T>::type> TermT; \
     return term<TermT>(t); \
   }
 
-FA_UNARY_OP(unary_minus, operator-, -m_t[i]);
-FA_UNARY_OP(unary_plus,  operator+, m_t[i]);
-FA_UNARY_OP(math_exp,    exp, std::exp(m_t[i]));
-FA_UNARY_OP(math_log,    log, std::log(m_t[i]));
-FA_UNARY_OP(math_log10,  log10, std::log10(m_t[i]));
-FA_UNARY_OP(math_sqrt,   sqrt, std::sqrt(m_t[i]));
-FA_UNARY_OP(math_cos,    cos, std::cos(m_t[i]));
-FA_UNARY_OP(math_sin,    sin, std::sin(m_t[i]));
-FA_UNARY_OP(math_tan,    tan, std::tan(m_t[i]));
-FA_UNARY_OP(math_acos,   acos, std::acos(m_t[i]));
-FA_UNARY_OP(math_asin,   asin, std::asin(m_t[i]));
-FA_UNARY_OP(math_atan,   atan, std::atan(m_t[i]));
-FA_UNARY_OP(math_cosh,   cosh, std::cosh(m_t[i]));
-FA_UNARY_OP(math_sinh,   sinh, std::sinh(m_t[i]));
-FA_UNARY_OP(math_tanh,   tanh, std::tanh(m_t[i]));
-FA_UNARY_OP(math_abs,    abs, std::abs(m_t[i]));
-FA_UNARY_OP(math_fabs,   fabs, std::fabs(m_t[i]));
+FA_UNARY_OP(unary_minus, operator-, 1, -m_t[i]);
+FA_UNARY_OP(unary_plus,  operator+, 0, m_t[i]);
+FA_UNARY_OP(math_exp,    exp, 20, std::exp(m_t[i]));
+FA_UNARY_OP(math_log,    log, 20, std::log(m_t[i]));
+FA_UNARY_OP(math_log10,  log10, 20, std::log10(m_t[i]));
+FA_UNARY_OP(math_sqrt,   sqrt, 1, std::sqrt(m_t[i]));
+FA_UNARY_OP(math_cos,    cos, 20, std::cos(m_t[i]));
+FA_UNARY_OP(math_sin,    sin, 20, std::sin(m_t[i]));
+FA_UNARY_OP(math_tan,    tan, 30, std::tan(m_t[i]));
+FA_UNARY_OP(math_acos,   acos, 30, std::acos(m_t[i]));
+FA_UNARY_OP(math_asin,   asin, 30, std::asin(m_t[i]));
+FA_UNARY_OP(math_atan,   atan, 30, std::atan(m_t[i]));
+FA_UNARY_OP(math_cosh,   cosh, 30, std::cosh(m_t[i]));
+FA_UNARY_OP(math_sinh,   sinh, 30, std::sinh(m_t[i]));
+FA_UNARY_OP(math_tanh,   tanh, 30, std::tanh(m_t[i]));
+FA_UNARY_OP(math_abs,    abs, 0, std::abs(m_t[i]));
+FA_UNARY_OP(math_fabs,   fabs, 0, std::fabs(m_t[i]));
 #undef FA_UNARY_OP
+
+//
+// Explicit streaming assignment -- streaming(u) = expr uses
+// streaming stores regardless of the size of u
+//
+struct streaming_ref {
+  explicit streaming_ref(FastArray& fa) : m_fa(fa) {}
+  template <class T>
+  streaming_ref& operator=(const T& rhs) {
+    FA_INSTRUMENT(streaming_ref(term<T>), "stream=", &signature<T>,
+                  m_fa.size());
+    m_fa.stream(term<T>(rhs), 0, m_fa.size());
+    return *this;
+  }
+  FastArray& m_fa;
+};
+
+inline streaming_ref streaming(FastArray& fa) {
+  return streaming_ref(fa);
+}
+
+//
+// User-defined elementwise kernels -- map(f, a, b, ...) applies
+// the functor f to the i-th element of every operand. Operands
+// may be FastArrays, scalars or other expressions, and the
+// result is an expression like any built-in operator.
+//
+template <class F, class... T>
+struct mapping {};
+
+template <class F, class... T>
+struct term<mapping<F, T...> > {
+  typedef typename promote_all<typename term<T>::ValueT...>::type ValueT;
+  term(const F& f, const term<T>&... args)
+    : m_f(f),
+      m_args(args...) {}
+  ValueT operator[](const IndexT i) const {
+    return apply(i, typename make_indices<sizeof...(T)>::type());
+  }
+  template <int... N>
+  ValueT apply(const IndexT i, indices<N...>) const {
+    return m_f(std::get<N>(m_args)[i]...);
+  }
+  bool aliases(const ScalarT* begin, const ScalarT* end) const {
+    return aliases(begin, end, typename make_indices<sizeof...(T)>::type());
+  }
+  template <int... N>
+  bool aliases(const ScalarT* begin, const ScalarT* end, indices<N...>) const {
+    const bool any[] = { false, std::get<N>(m_args).aliases(begin, end)... };
+    return std::count(any, any + sizeof...(T) + 1, true) > 0;
+  }
+  bool shifted(const ScalarT* begin, const ScalarT* end) const {
+    return shifted(begin, end, typename make_indices<sizeof...(T)>::type());
+  }
+  template <int... N>
+  bool shifted(const ScalarT* begin, const ScalarT* end, indices<N...>) const {
+    const bool any[] = { false, std::get<N>(m_args).shifted(begin, end)... };
+    return std::count(any, any + sizeof...(T) + 1, true) > 0;
+  }
+  static int precedence() {
+    return PRECEDENCE_ATOM;
+  }
+  static void describe(std::string* out, int* next_array) {
+    const Describer describers[] = { &term<T>::describe... };
+    out->append("map(");
+    for (size_t k = 0; k < sizeof...(T); ++k) {
+      if (k > 0)
+        out->append(",");
+      describers[k](out, next_array);
+    }
+    out->append(")");
+  }
+  static int arrays() {
+    const int counts[] = { 0, term<T>::arrays()... };
+    return std::accumulate(counts, counts + sizeof...(T) + 1, 0);
+  }
+  // the functor's own operations are not known
+  static int flops() {
+    const int counts[] = { 0, term<T>::flops()... };
+    return std::accumulate(counts, counts + sizeof...(T) + 1, 0);
+  }
+  const F m_f;
+  const std::tuple<term<T>...> m_args;
+};
+
+template <class F, class... T>
+inline term<mapping<F, typename operand<T>::type...> >
+map(const F& f, const T&... args) {
+  typedef mapping<F, typename operand<T>::type...> TermT;
+  return term<TermT>(f, args...);
+}
+
+//
+// Multi-output assignment -- tie(u, v, w) = std::make_tuple(e1, e2, e3)
+// evaluates every expression in a single loop so that operands shared
+// between them are loaded once per element. All outputs must have
+// the same size, or std::length_error is thrown.
+//
+template <class... A>
+struct tied {
+  explicit tied(A&... arrays) : m_arrays(arrays...) {}
+
+  template <class... E>
+  tied& operator=(const std::tuple<E...>& rhs) {
+    static_assert(sizeof...(E) == sizeof...(A),
+                  "tie() and the assigned tuple must have the same arity");
+    assign(rhs, typename make_indices<sizeof...(A)>::type());
+    return *this;
+  }
+
+ private:
+  template <class... E, int... N>
+  void assign(const std::tuple<E...>& rhs, indices<N...>) {
+    const std::tuple<term<E>...> terms(std::get<N>(rhs)...);
+    const IndexT size = std::get<0>(m_arrays).size();
+    const IndexT sizes[] = { std::get<N>(m_arrays).size()... };
+    for (size_t k = 1; k < sizeof...(A); ++k)
+      if (sizes[k] != size)
+        throw std::length_error(
+            "fa::tie: all outputs must have the same size");
+    FA_INSTRUMENT(tied(term<E>...), "tie=", &tuple_signature<E...>, size);
+    // data() unshares copy-on-write outputs once, not per element
+    ScalarT* const out[] = { std::get<N>(m_arrays).data()... };
+    for (IndexT i = 0; i < size; ++i) {
+      const int expand[] = { (out[N][i] = std::get<N>(terms)[i], 0)... };
+      (void) expand;
+    }
+  }
+
+  // (e1,e2,...), with arrays numbered across the whole tuple
+  template <class... E>
+  static std::string tuple_signature() {
+    std::string out("(");
+    int next_array = 0;
+    const Describer describers[] = { &term<E>::describe... };
+    for (size_t k = 0; k < sizeof...(E); ++k) {
+      if (k > 0)
+        out.append(",");
+      describers[k](&out, &next_array);
+    }
+    return out.append(")");
+  }
+
+  std::tuple<A&...> m_arrays;
+};
+
+template <class... A>
+inline tied<A...> tie(A&... arrays) {
+  return tied<A...>(arrays...);
+}
 }  // namespace fa
 
 #endif  // SRC_FASTARRAY_HPP_
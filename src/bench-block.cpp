@@ -0,0 +1,87 @@
+// Copyright 2011 Patrick K. Notz
+//
+// Chained-statement kernel: a timestep made of many dependent
+// assignments, evaluated statement by statement and as one
+// cache-blocked DeferredBlock.
+//
+#include <FastArray.hpp>
+#include <fa_bench.hpp>
+#include <fa_block.hpp>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+const int NUM_STEPS = 5;
+
+struct state {
+  explicit state(const fa::IndexT n)
+    : a(n, 1.0), b(n, 0.5), c(n, 0.25),
+      t0(n, 0.0), t1(n, 0.0), t2(n, 0.0), t3(n, 0.0) {}
+  fa::FastArray a, b, c, t0, t1, t2, t3;
+};
+
+void eager_step(state& s) {
+  s.t0 = s.a * s.b + s.c;
+  s.t1 = s.t0 * 0.5 - s.a;
+  s.t2 = s.t1 * s.t0 + s.b;
+  s.t3 = s.t2 - s.t1 * 0.25;
+  s.t0 = s.t3 * s.t3 + s.t2;
+  s.t1 = s.t0 / (s.t2 + 2.0);
+  s.t2 = s.t1 + s.t3 * s.c;
+  s.t3 = s.t2 * 0.125 + s.t0;
+  s.a = s.a + s.t3 * 1e-9;
+  s.b = s.b - s.t1 * 1e-9;
+  s.c = s.c + s.t2 * 1e-9;
+}
+
+void record_step(fa::DeferredBlock& block, state& s) {
+  block.assign(s.t0, s.a * s.b + s.c)
+       .assign(s.t1, s.t0 * 0.5 - s.a)
+       .assign(s.t2, s.t1 * s.t0 + s.b)
+       .assign(s.t3, s.t2 - s.t1 * 0.25)
+       .assign(s.t0, s.t3 * s.t3 + s.t2)
+       .assign(s.t1, s.t0 / (s.t2 + 2.0))
+       .assign(s.t2, s.t1 + s.t3 * s.c)
+       .assign(s.t3, s.t2 * 0.125 + s.t0)
+       .assign(s.a, s.a + s.t3 * 1e-9)
+       .assign(s.b, s.b - s.t1 * 1e-9)
+       .assign(s.c, s.c + s.t2 * 1e-9);
+}
+
+}  // namespace
+
+int main(int argc, char * argv[]) {
+  const fa::IndexT n = argc > 1 ? std::atoi(argv[1]) : (1 << 22);
+  const fa::IndexT tile = argc > 2 ? std::atoi(argv[2])
+                                   : fa::DeferredBlock::default_tile_size;
+
+  state eager(n);
+  eager_step(eager);
+  double t0 = fa::bench::now();
+  for (int step = 0; step < NUM_STEPS; ++step)
+    eager_step(eager);
+  const double t_eager = (fa::bench::now() - t0) / NUM_STEPS;
+
+  state blocked(n);
+  fa::DeferredBlock block(tile);
+  record_step(block, blocked);
+  block.run();
+  t0 = fa::bench::now();
+  for (int step = 0; step < NUM_STEPS; ++step)
+    block.run();
+  const double t_block = (fa::bench::now() - t0) / NUM_STEPS;
+
+  double max_diff = 0;
+  for (fa::IndexT i = 0; i < n; ++i)
+    max_diff = std::max(max_diff, std::abs(eager.t3[i] - blocked.t3[i]));
+
+  std::printf("elements:     %d\n", n);
+  std::printf("tile:         %d\n", tile);
+  std::printf("statements:   %d\n", static_cast<int>(block.num_statements()));
+  std::printf("eager:        %.3f ms/step\n", t_eager * 1e3);
+  std::printf("blocked:      %.3f ms/step\n", t_block * 1e3);
+  std::printf("speedup:      %.2fx\n", t_eager / t_block);
+  std::printf("max |diff|:   %g\n", max_diff);
+  return max_diff == 0 ? 0 : 1;
+}
@@ -0,0 +1,158 @@
+// Copyright 2011 Patrick K. Notz
+//
+// Compression ratio and bandwidth of the codecs (fa_codec.hpp) on
+// fields of increasing difficulty: "lossless", and "bounded" with the
+// absolute error bound given by --bound= (default 1e-3). Bandwidth is
+// of the decoded array, in GB/s; the ratio is encoded over decoded
+// bytes. Lossless encodings are checked to decode exactly and bounded
+// ones to stay within the bound. Also accepts the fa_bench options;
+// the default size is 2^22.
+//
+#include <FastArray.hpp>
+#include <fa_bench.hpp>
+#include <fa_codec.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Field {
+  const char* name;
+  double (*value)(fa::IndexT i);
+};
+
+// Deterministic noise in [-1, 1)
+double noise(const fa::IndexT i) {
+  uint64_t x = static_cast<uint64_t>(i) * 0x9E3779B97F4A7C15ull;
+  x ^= x >> 29;
+  x *= 0xBF58476D1CE4E5B9ull;
+  x ^= x >> 32;
+  return static_cast<double>(x >> 11) / (1ull << 52) - 1.0;
+}
+
+double constant(const fa::IndexT) {
+  return 101325.0;
+}
+
+double smooth(const fa::IndexT i) {
+  return 300.0 + 20.0 * std::sin(1e-4 * i) + 5.0 * std::cos(3e-5 * i);
+}
+
+double smooth_noisy(const fa::IndexT i) {
+  return smooth(i) * (1.0 + 1e-9 * noise(i));
+}
+
+double random(const fa::IndexT i) {
+  return noise(i);
+}
+
+const Field FIELDS[] = {
+  { "constant", &constant },
+  { "smooth", &smooth },
+  { "noisy", &smooth_noisy },
+  { "random", &random }
+};
+
+// bound 0 is the lossless codec
+struct encode_call {
+  encode_call(const fa::FastArray& x, const double bound,
+              std::vector<char>* out)
+    : m_x(x), m_bound(bound), m_out(out) {}
+  void operator()() const {
+    m_out->clear();
+    if (m_bound > 0)
+      fa::codec::encode_bounded(m_x, m_bound, m_out);
+    else
+      fa::codec::encode(m_x, m_out);
+  }
+  const fa::FastArray& m_x;
+  const double m_bound;
+  std::vector<char>* m_out;
+};
+
+struct decode_call {
+  decode_call(const std::vector<char>& in, const double bound,
+              fa::FastArray* out)
+    : m_in(in), m_bound(bound), m_out(out) {}
+  void operator()() const {
+    if (m_bound > 0)
+      fa::codec::decode_bounded(&m_in[0], m_in.size(), m_out->data());
+    else
+      fa::codec::decode(&m_in[0], m_in.size(), m_out->data());
+  }
+  const std::vector<char>& m_in;
+  const double m_bound;
+  fa::FastArray* m_out;
+};
+
+}  // namespace
+
+int main(int argc, char * argv[]) {
+  double bound = 1e-3;
+  std::vector<char*> args;
+  for (int i = 0; i < argc; ++i) {
+    if (std::strncmp(argv[i], "--bound=", 8) == 0)
+      bound = std::atof(argv[i] + 8);
+    else
+      args.push_back(argv[i]);
+  }
+  fa::bench::Options options;
+  options.sizes.assign(1, 1 << 22);
+  if (!fa::bench::parse_options(static_cast<int>(args.size()), &args[0],
+                                &options) || !(bound > 0))
+    return 1;
+
+  if (options.csv)
+    std::printf("field,codec,size,ratio,max_error,encode_gb_per_s,"
+                "decode_gb_per_s\n");
+  else
+    std::printf("%-9s %-8s %10s %8s %10s %12s %12s\n", "field", "codec",
+                "size", "ratio", "max error", "encode GB/s", "decode GB/s");
+  const char* codecs[] = { "lossless", "bounded" };
+  for (size_t s = 0; s < options.sizes.size(); ++s) {
+    const fa::IndexT n = options.sizes[s];
+    fa::FastArray x(n), y(n);
+    for (size_t f = 0; f < sizeof(FIELDS) / sizeof(FIELDS[0]); ++f) {
+      const Field& field = FIELDS[f];
+      if (std::string(field.name).find(options.filter) == std::string::npos)
+        continue;
+      for (fa::IndexT i = 0; i < n; ++i)
+        x[i] = field.value(i);
+      for (int c = 0; c < 2; ++c) {
+        const double b = c == 0 ? 0 : bound;
+        std::vector<char> encoded;
+        const fa::bench::Stats encoding = fa::bench::summarize(
+            fa::bench::sample(encode_call(x, b, &encoded), options));
+        const fa::bench::Stats decoding = fa::bench::summarize(
+            fa::bench::sample(decode_call(encoded, b, &y), options));
+        double max_error = 0;
+        for (fa::IndexT i = 0; i < n; ++i)
+          max_error = std::max(max_error, std::fabs(x[i] - y[i]));
+        if (c == 0 ? std::memcmp(x.data(), y.data(),
+                                 n * sizeof(fa::ScalarT)) != 0
+                   : !(max_error < bound)) {
+          std::printf("%s, %s: decoded data out of bounds\n", field.name,
+                      codecs[c]);
+          return 1;
+        }
+        const double bytes = static_cast<double>(n) * sizeof(fa::ScalarT);
+        const double ratio = encoded.size() / bytes;
+        if (options.csv)
+          std::printf("%s,%s,%d,%.5f,%.3g,%.3f,%.3f\n", field.name, codecs[c],
+                      n, ratio, max_error, bytes / encoding.median * 1e-9,
+                      bytes / decoding.median * 1e-9);
+        else
+          std::printf("%-9s %-8s %10d %8.5f %10.3g %12.3f %12.3f\n",
+                      field.name, codecs[c], n, ratio, max_error,
+                      bytes / encoding.median * 1e-9,
+                      bytes / decoding.median * 1e-9);
+      }
+    }
+  }
+  return 0;
+}
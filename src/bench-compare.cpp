@@ -0,0 +1,227 @@
+// Copyright 2011 Patrick K. Notz
+//
+// Times a catalog of expressions evaluated four ways -- FastArray
+// expression templates, a hand-written restrict loop, std::valarray
+// and naive evaluation that materializes a temporary per node -- and
+// flags every expression where FastArray is slower than the hand loop
+// by more than --threshold (a ratio, default 1.10). Exits non-zero
+// if any expression is flagged.
+//
+// The hand loop uses cached stores, so FastArray's streaming stores
+// (streaming_threshold()) are turned off to compare like with like;
+// bench-stream measures the streaming path.
+//
+#include <FastArray.hpp>
+#include <fa_bench.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <valarray>
+#include <vector>
+
+namespace {
+
+//
+// Naive evaluation -- every node is assigned into a freshly
+// allocated FastArray before its parent is evaluated. The overloads
+// are inline so the ones no catalog entry uses do not warn.
+//
+struct eager {
+  explicit eager(const std::shared_ptr<const fa::FastArray>& v) : m_v(v) {}
+  const fa::FastArray& operator*() const { return *m_v; }
+  std::shared_ptr<const fa::FastArray> m_v;
+};
+
+void no_delete(const fa::FastArray*) {}
+
+eager leaf(const fa::FastArray& v) {
+  return eager(std::shared_ptr<const fa::FastArray>(&v, no_delete));
+}
+
+template <class T>
+eager materialize(const fa::IndexT n, const T& expr) {
+  std::shared_ptr<fa::FastArray> t(new fa::FastArray(n));
+  *t = expr;
+  return eager(t);
+}
+
+#define FA_EAGER_BINARY(OPERATOR) \
+  inline eager OPERATOR(const eager& l, const eager& r) { \
+    return materialize((*l).size(), OPERATOR(*l, *r)); \
+  } \
+  inline eager OPERATOR(const eager& l, const double r) { \
+    return materialize((*l).size(), OPERATOR(*l, r)); \
+  } \
+  inline eager OPERATOR(const double l, const eager& r) { \
+    return materialize((*r).size(), OPERATOR(l, *r)); \
+  }
+
+FA_EAGER_BINARY(operator+)
+FA_EAGER_BINARY(operator-)
+FA_EAGER_BINARY(operator*)
+FA_EAGER_BINARY(operator/)
+FA_EAGER_BINARY(pow)
+FA_EAGER_BINARY(atan2)
+#undef FA_EAGER_BINARY
+
+#define FA_EAGER_UNARY(OPERATOR) \
+  inline eager OPERATOR(const eager& t) { \
+    return materialize((*t).size(), OPERATOR(*t)); \
+  }
+
+FA_EAGER_UNARY(operator-)
+FA_EAGER_UNARY(exp)
+FA_EAGER_UNARY(log)
+FA_EAGER_UNARY(log10)
+FA_EAGER_UNARY(sqrt)
+FA_EAGER_UNARY(cos)
+FA_EAGER_UNARY(sin)
+FA_EAGER_UNARY(tan)
+#undef FA_EAGER_UNARY
+
+struct Workspace {
+  explicit Workspace(const fa::IndexT n)
+    : ops(n),
+      va(ops.a.data(), n), vb(ops.b.data(), n),
+      vc(ops.c.data(), n), vd(ops.d.data(), n),
+      vout(0.0, n) {}
+  fa::bench::Operands ops;
+  std::valarray<double> va, vb, vc, vd, vout;
+};
+
+typedef void (*Kernel)(Workspace& w);
+
+struct Entry {
+  const char* name;
+  Kernel fastarray;
+  Kernel hand;
+  Kernel valarray;
+  Kernel naive;
+};
+
+//
+// FA_COMPARE(name, expr) -- expr is written once in terms of a, b,
+// c and d, and is evaluated with each of the four approaches
+//
+#define FA_COMPARE(NAME, EXPR) \
+  { #NAME, \
+    [](Workspace& w) { \
+      const fa::FastArray& a = w.ops.a; \
+      const fa::FastArray& b = w.ops.b; \
+      const fa::FastArray& c = w.ops.c; \
+      const fa::FastArray& d = w.ops.d; \
+      (void) a; (void) b; (void) c; (void) d; \
+      w.ops.out = EXPR; \
+    }, \
+    [](Workspace& w) { \
+      using std::atan2; using std::cos; using std::exp; using std::log; \
+      using std::log10; using std::pow; using std::sin; using std::sqrt; \
+      using std::tan; \
+      const fa::IndexT n = w.ops.out.size(); \
+      const double* FA_RESTRICT pa = w.ops.a.data(); \
+      const double* FA_RESTRICT pb = w.ops.b.data(); \
+      const double* FA_RESTRICT pc = w.ops.c.data(); \
+      const double* FA_RESTRICT pd = w.ops.d.data(); \
+      double* FA_RESTRICT out = w.ops.out.data(); \
+      for (fa::IndexT i = 0; i < n; ++i) { \
+        const double a = pa[i], b = pb[i], c = pc[i], d = pd[i]; \
+        (void) a; (void) b; (void) c; (void) d; \
+        out[i] = EXPR; \
+      } \
+    }, \
+    [](Workspace& w) { \
+      const std::valarray<double>& a = w.va; \
+      const std::valarray<double>& b = w.vb; \
+      const std::valarray<double>& c = w.vc; \
+      const std::valarray<double>& d = w.vd; \
+      (void) a; (void) b; (void) c; (void) d; \
+      w.vout = EXPR; \
+    }, \
+    [](Workspace& w) { \
+      const eager a = leaf(w.ops.a), b = leaf(w.ops.b); \
+      const eager c = leaf(w.ops.c), d = leaf(w.ops.d); \
+      (void) a; (void) b; (void) c; (void) d; \
+      w.ops.out = *(EXPR); \
+    } }
+
+const Entry catalog[] = {
+  FA_COMPARE(add,           a + b),
+  FA_COMPARE(triad,         a + 2.5 * b),
+  FA_COMPARE(several_binop, a + b * c / (d + 13.0)),
+  FA_COMPARE(horner,        ((a * b + c) * b + d) * b),
+  FA_COMPARE(negate_add,    -a + b),
+  FA_COMPARE(hypot_div,     sqrt(a * a + b * b) / c),
+  FA_COMPARE(exp_log,       exp(a) * log(b)),
+  FA_COMPARE(trig,          sin(a) * cos(b) + tan(c)),
+  FA_COMPARE(atan2,         atan2(a, b)),
+  FA_COMPARE(pow,           pow(a, b)),
+  FA_COMPARE(kitchen_sink,
+             log10(exp(a) + cos(b) * pow(c, 2.5) / (-d + 13.0))),
+};
+#undef FA_COMPARE
+
+struct run_kernel {
+  run_kernel(Kernel kernel, Workspace* w) : m_kernel(kernel), m_w(w) {}
+  void operator()() const { m_kernel(*m_w); }
+  Kernel m_kernel;
+  Workspace* m_w;
+};
+
+double median_time(Kernel kernel, Workspace* w,
+                   const fa::bench::Options& options) {
+  return fa::bench::summarize(
+      fa::bench::sample(run_kernel(kernel, w), options)).median;
+}
+
+}  // namespace
+
+int main(int argc, char * argv[]) {
+  double threshold = 1.10;
+  std::vector<char*> args;
+  for (int i = 0; i < argc; ++i) {
+    if (std::strncmp(argv[i], "--threshold=", 12) == 0)
+      threshold = std::atof(argv[i] + 12);
+    else
+      args.push_back(argv[i]);
+  }
+  fa::bench::Options options;
+  if (!fa::bench::parse_options(static_cast<int>(args.size()), &args[0],
+                                &options))
+    return 1;
+  // the same store path as the hand loop at every size
+  fa::set_streaming_threshold(std::numeric_limits<size_t>::max());
+
+  std::printf("%-14s %10s %12s %12s %12s %12s %8s\n", "expression", "size",
+              "fastarray", "hand", "valarray", "naive", "fa/hand");
+  int num_slow = 0;
+  for (size_t s = 0; s < options.sizes.size(); ++s) {
+    const fa::IndexT n = options.sizes[s];
+    Workspace w(n);
+    for (size_t k = 0; k < sizeof(catalog) / sizeof(catalog[0]); ++k) {
+      const Entry& e = catalog[k];
+      if (std::string(e.name).find(options.filter) == std::string::npos)
+        continue;
+      const double t_fa = median_time(e.fastarray, &w, options);
+      const double t_hand = median_time(e.hand, &w, options);
+      const double t_val = median_time(e.valarray, &w, options);
+      const double t_naive = median_time(e.naive, &w, options);
+      const double ratio = t_fa / t_hand;
+      const bool slow = ratio > threshold;
+      num_slow += slow;
+      std::printf("%-14s %10d %10.3fms %10.3fms %10.3fms %10.3fms %8.2f%s\n",
+                  e.name, n, t_fa * 1e3, t_hand * 1e3, t_val * 1e3,
+                  t_naive * 1e3, ratio, slow ? "  SLOW" : "");
+      std::fflush(stdout);
+    }
+  }
+  if (num_slow > 0) {
+    std::printf("%d expression(s) slower than the hand-written loop by"
+                " more than %.0f%%\n", num_slow, (threshold - 1) * 100);
+    return 1;
+  }
+  return 0;
+}
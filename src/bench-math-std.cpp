@@ -0,0 +1,8 @@
+// Copyright 2011 Patrick K. Notz
+//
+// bench-math kernels on the default path: the project's flags, one
+// std:: call per element
+//
+#include <bench-math.hpp>
+
+FA_MATH_PATH(std_math_path, "std")
@@ -0,0 +1,10 @@
+// Copyright 2011 Patrick K. Notz
+//
+// bench-math kernels on the vectorized path. This file is compiled
+// with -ffast-math (see CMakeLists.txt), under which GCC and glibc
+// evaluate the math nodes with libmvec's SIMD variants, e.g.
+// _ZGVbN2v_exp, instead of one scalar call per element.
+//
+#include <bench-math.hpp>
+
+FA_MATH_PATH(vector_math_path, "vector")
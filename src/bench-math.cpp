@@ -0,0 +1,152 @@
+// Copyright 2011 Patrick K. Notz
+//
+// Accuracy and throughput of every math node. Each node is evaluated
+// over a representative domain by every MathPath (see bench-math.hpp)
+// and compared with a long double reference, reporting the maximum
+// and mean error in units in the last place (ULP) of the double
+// result, and elements per second. With --max-ulp=N it exits non-zero
+// when any node on any path is off by more than N ULP, which is how
+// the math-accuracy test uses it. Also accepts the fa_bench options;
+// the default size is 2^16.
+//
+#include <bench-math.hpp>
+#include <fa_bench.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace {
+
+typedef long double (*Reference)(long double lx, long double ly);
+
+struct Node {
+  const char* name;
+  Reference reference;
+  double x0, x1, y0, y1;
+};
+
+#define FA_MATH_REFERENCE(NAME, EXPR, REFERENCE, X0, X1, Y0, Y1) \
+  long double reference_##NAME(long double lx, long double ly) { \
+    (void) ly; \
+    return REFERENCE; \
+  }
+#define FA_MATH_NODE(NAME, EXPR, REFERENCE, X0, X1, Y0, Y1) \
+  { #NAME, &reference_##NAME, X0, X1, Y0, Y1 },
+
+FA_MATH_NODES(FA_MATH_REFERENCE)
+const Node NODES[] = { FA_MATH_NODES(FA_MATH_NODE) };
+
+const fa::bench::MathPath* const PATHS[] = {
+  &fa::bench::std_math_path,
+  &fa::bench::vector_math_path
+};
+
+// n evenly spaced points of [lo, hi], in a shuffled order so that
+// branchy implementations are not favored by sorted input
+void fill(fa::FastArray* v, const double lo, const double hi) {
+  const fa::IndexT n = v->size();
+  const fa::IndexT stride = 7919;  // prime, coprime with sizes of interest
+  for (fa::IndexT i = 0; i < n; ++i) {
+    const fa::IndexT k = static_cast<fa::IndexT>(
+        (static_cast<int64_t>(i) * stride) % n);
+    (*v)[i] = n > 1 ? lo + (hi - lo) * k / (n - 1) : lo;
+  }
+}
+
+// Error of a double result in ULP of the correctly rounded result
+double ulp_error(const double result, const long double reference) {
+  const double rounded = static_cast<double>(reference);
+  if (std::isnan(rounded) || std::isinf(rounded))
+    return result == rounded || (std::isnan(result) && std::isnan(rounded))
+               ? 0 : std::numeric_limits<double>::infinity();
+  const double magnitude = std::fabs(rounded);
+  const double ulp = magnitude > 0
+      ? std::nextafter(magnitude, std::numeric_limits<double>::infinity()) -
+            magnitude
+      : std::numeric_limits<double>::denorm_min();
+  return static_cast<double>(std::fabs(result - reference) / ulp);
+}
+
+struct kernel_call {
+  kernel_call(fa::bench::MathKernel kernel, fa::FastArray* out,
+              const fa::FastArray& x, const fa::FastArray& y)
+    : m_kernel(kernel),
+      m_out(out),
+      m_x(x),
+      m_y(y) {}
+  void operator()() const {
+    m_kernel(*m_out, m_x, m_y);
+  }
+  fa::bench::MathKernel m_kernel;
+  fa::FastArray* m_out;
+  const fa::FastArray& m_x;
+  const fa::FastArray& m_y;
+};
+
+}  // namespace
+
+int main(int argc, char * argv[]) {
+  double max_ulp = -1;
+  std::vector<char*> args;
+  for (int i = 0; i < argc; ++i) {
+    if (std::strncmp(argv[i], "--max-ulp=", 10) == 0)
+      max_ulp = std::atof(argv[i] + 10);
+    else
+      args.push_back(argv[i]);
+  }
+  fa::bench::Options options;
+  options.sizes.assign(1, 1 << 16);
+  if (!fa::bench::parse_options(static_cast<int>(args.size()), &args[0],
+                                &options))
+    return 1;
+
+  if (options.csv)
+    std::printf("node,path,size,max_ulp,mean_ulp,elements_per_s\n");
+  else
+    std::printf("%-6s %-7s %10s %11s %11s %12s\n", "node", "path", "size",
+                "max(ulp)", "mean(ulp)", "Melem/s");
+  int num_failed = 0;
+  for (size_t s = 0; s < options.sizes.size(); ++s) {
+    const fa::IndexT n = options.sizes[s];
+    fa::FastArray x(n), y(n), out(n);
+    for (size_t k = 0; k < sizeof(NODES) / sizeof(NODES[0]); ++k) {
+      const Node& node = NODES[k];
+      if (std::string(node.name).find(options.filter) == std::string::npos)
+        continue;
+      fill(&x, node.x0, node.x1);
+      fill(&y, node.y0, node.y1);
+      for (size_t p = 0; p < sizeof(PATHS) / sizeof(PATHS[0]); ++p) {
+        const fa::bench::MathPath& path = *PATHS[p];
+        const kernel_call call(path.kernels[k], &out, x, y);
+        const fa::bench::Stats stats =
+            fa::bench::summarize(fa::bench::sample(call, options));
+        double worst = 0, total = 0;
+        for (fa::IndexT i = 0; i < n; ++i) {
+          const double e = ulp_error(out[i], node.reference(x[i], y[i]));
+          worst = std::max(worst, e);
+          total += e;
+        }
+        const double mean = n > 0 ? total / n : 0;
+        const double rate = n / stats.median;
+        const bool failed = max_ulp >= 0 && !(worst <= max_ulp);
+        num_failed += failed;
+        if (options.csv)
+          std::printf("%s,%s,%d,%.3f,%.4f,%.0f\n", node.name, path.name, n,
+                      worst, mean, rate);
+        else
+          std::printf("%-6s %-7s %10d %11.3f %11.4f %12.1f%s\n", node.name,
+                      path.name, n, worst, mean, rate * 1e-6,
+                      failed ? "  FAIL" : "");
+      }
+    }
+  }
+  if (num_failed > 0) {
+    std::printf("%d node(s) off by more than %g ulp\n", num_failed, max_ulp);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,73 @@
+// Copyright 2011 Patrick K. Notz
+#ifndef SRC_BENCH_MATH_HPP_
+#define SRC_BENCH_MATH_HPP_
+
+#include <FastArray.hpp>
+
+//
+// The math nodes swept by bench-math, with the long double reference
+// and the domain x in [X0, X1], y in [Y0, Y1] of each. Kernels see
+// the operands as x and y, references as lx and ly.
+//
+#define FA_MATH_NODES(NODE) \
+  NODE(exp,   exp(x),      std::exp(lx),        -700, 700, 0, 0) \
+  NODE(log,   log(x),      std::log(lx),        1e-3, 1e3, 0, 0) \
+  NODE(log10, log10(x),    std::log10(lx),      1e-3, 1e3, 0, 0) \
+  NODE(sqrt,  sqrt(x),     std::sqrt(lx),       0, 1e6, 0, 0) \
+  NODE(cos,   cos(x),      std::cos(lx),        -100, 100, 0, 0) \
+  NODE(sin,   sin(x),      std::sin(lx),        -100, 100, 0, 0) \
+  NODE(tan,   tan(x),      std::tan(lx),        -1.5, 1.5, 0, 0) \
+  NODE(acos,  acos(x),     std::acos(lx),       -1, 1, 0, 0) \
+  NODE(asin,  asin(x),     std::asin(lx),       -1, 1, 0, 0) \
+  NODE(atan,  atan(x),     std::atan(lx),       -100, 100, 0, 0) \
+  NODE(cosh,  cosh(x),     std::cosh(lx),       -700, 700, 0, 0) \
+  NODE(sinh,  sinh(x),     std::sinh(lx),       -700, 700, 0, 0) \
+  NODE(tanh,  tanh(x),     std::tanh(lx),       -20, 20, 0, 0) \
+  NODE(abs,   abs(x),      std::fabs(lx),       -1e3, 1e3, 0, 0) \
+  NODE(fabs,  fabs(x),     std::fabs(lx),       -1e3, 1e3, 0, 0) \
+  NODE(pow,   pow(x, y),   std::pow(lx, ly),    0.1, 10, -20, 20) \
+  NODE(max,   max(x, y),   std::max(lx, ly),    -10, 10, -10, 10) \
+  NODE(min,   min(x, y),   std::min(lx, ly),    -10, 10, -10, 10) \
+  NODE(atan2, atan2(x, y), std::atan2(lx, ly),  -10, 10, -10, 10)
+
+namespace fa {
+namespace bench {
+
+typedef void (*MathKernel)(FastArray& out, const FastArray& x,
+                           const FastArray& y);
+
+//
+// A way of evaluating the math nodes: kernels[k] is the k-th entry
+// of FA_MATH_NODES compiled with that path's flags
+//
+struct MathPath {
+  const char* name;
+  const MathKernel* kernels;
+};
+
+// compiled with the project flags, calling the scalar std:: functions
+extern const MathPath std_math_path;
+// compiled with -ffast-math, which lets the compiler call a vector
+// math library (glibc's libmvec) from the evaluation loop
+extern const MathPath vector_math_path;
+
+}  // namespace bench
+}  // namespace fa
+
+// Defines the kernels of a MathPath named NAME in the current TU
+#define FA_MATH_KERNEL(NAME, EXPR, REFERENCE, X0, X1, Y0, Y1) \
+  static void fa_math_##NAME(fa::FastArray& out, const fa::FastArray& x, \
+                             const fa::FastArray& y) { \
+    (void) y; \
+    out.evaluate<fa::assign_op>(EXPR, 0, out.size()); \
+  }
+#define FA_MATH_KERNEL_ENTRY(NAME, EXPR, REFERENCE, X0, X1, Y0, Y1) \
+  &fa_math_##NAME,
+#define FA_MATH_PATH(PATH, LABEL) \
+  FA_MATH_NODES(FA_MATH_KERNEL) \
+  static const fa::bench::MathKernel fa_math_kernels[] = { \
+    FA_MATH_NODES(FA_MATH_KERNEL_ENTRY) \
+  }; \
+  const fa::bench::MathPath fa::bench::PATH = { LABEL, fa_math_kernels };
+
+#endif  // SRC_BENCH_MATH_HPP_
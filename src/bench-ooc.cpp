@@ -0,0 +1,134 @@
+// Copyright 2011 Patrick K. Notz
+//
+// Out-of-core evaluation of out = a + s*b over files, reported as
+// file bandwidth (three arrays of traffic per element). "serial"
+// reads, evaluates and writes one chunk after another; "ooc" is
+// fa::ooc::evaluate, which overlaps the reads and writes with the
+// evaluation. Files go to $TMPDIR (default /tmp); unless the arrays
+// exceed the page cache, this measures the cache rather than the
+// disk. Accepts the fa_bench options plus --chunk=elements; the
+// default size is 2^24.
+//
+#include <FastArray.hpp>
+#include <fa_bench.hpp>
+#include <fa_io.hpp>
+#include <fa_ooc.hpp>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string temp_path(const char* name) {
+  const char* dir = getenv("TMPDIR");
+  return std::string(dir ? dir : "/tmp").append("/fa-bench-ooc-")
+      .append(name);
+}
+
+const auto triad = [](const fa::FastArrayView& a,
+                      const fa::FastArrayView& b) {
+  return a + 2.0 * b;
+};
+
+struct serial_pass {
+  serial_pass(const fa::ooc::Input& a, const fa::ooc::Input& b,
+              const std::string& out, const fa::IndexT chunk)
+    : m_a(a), m_b(b), m_out(out), m_chunk(chunk) {}
+  void operator()() const {
+    fa::io::Writer writer(m_out);
+    const fa::IndexT size = m_a.size();
+    const fa::IndexT length = std::min(m_chunk, size);
+    fa::FastArray a(length), b(length), result(length);
+    for (fa::IndexT begin = 0; begin < size; begin += m_chunk) {
+      const fa::IndexT n = std::min(m_chunk, size - begin);
+      m_a.read(begin, n, a.data());
+      m_b.read(begin, n, b.data());
+      result.resize(n);
+      fa::parallel(result) = triad(fa::FastArrayView(a.data(), n),
+                                   fa::FastArrayView(b.data(), n));
+      writer.write(result);
+    }
+    writer.close();
+  }
+  const fa::ooc::Input& m_a;
+  const fa::ooc::Input& m_b;
+  const std::string m_out;
+  const fa::IndexT m_chunk;
+};
+
+struct ooc_pass {
+  ooc_pass(const fa::ooc::Input& a, const fa::ooc::Input& b,
+           const std::string& out, const fa::IndexT chunk)
+    : m_a(a), m_b(b), m_out(out), m_chunk(chunk) {}
+  void operator()() const {
+    fa::io::Writer writer(m_out);
+    fa::ooc::evaluate(&writer, m_chunk, triad, m_a, m_b);
+    writer.close();
+  }
+  const fa::ooc::Input& m_a;
+  const fa::ooc::Input& m_b;
+  const std::string m_out;
+  const fa::IndexT m_chunk;
+};
+
+}  // namespace
+
+int main(int argc, char * argv[]) {
+  fa::IndexT chunk = fa::ooc::DEFAULT_CHUNK;
+  std::vector<char*> args;
+  for (int i = 0; i < argc; ++i) {
+    if (std::strncmp(argv[i], "--chunk=", 8) == 0)
+      chunk = std::atoi(argv[i] + 8);
+    else
+      args.push_back(argv[i]);
+  }
+  fa::bench::Options options;
+  options.sizes.assign(1, 1 << 24);
+  if (!fa::bench::parse_options(static_cast<int>(args.size()), &args[0],
+                                &options) || chunk <= 0)
+    return 1;
+
+  const std::string a_path = temp_path("a.fa");
+  const std::string b_path = temp_path("b.fa");
+  const std::string out_path = temp_path("out.fa");
+  if (options.csv)
+    std::printf("variant,size,chunk,seconds,mb_per_s\n");
+  else
+    std::printf("%-8s %12s %10s %10s %10s\n", "variant", "size", "chunk",
+                "seconds", "MB/s");
+  for (size_t s = 0; s < options.sizes.size(); ++s) {
+    const fa::IndexT n = options.sizes[s];
+    {
+      fa::FastArray x(n, 1.0);
+      fa::io::save(a_path, x);
+      x = 0.5;
+      fa::io::save(b_path, x);
+    }
+    const fa::ooc::Input a(a_path), b(b_path);
+    const double bytes = 3.0 * n * sizeof(fa::ScalarT);
+    const serial_pass serial(a, b, out_path, chunk);
+    const ooc_pass ooc(a, b, out_path, chunk);
+    const char* names[] = { "serial", "ooc" };
+    for (int v = 0; v < 2; ++v) {
+      if (std::string(names[v]).find(options.filter) == std::string::npos)
+        continue;
+      const fa::bench::Stats stats = fa::bench::summarize(
+          v == 0 ? fa::bench::sample(serial, options)
+                 : fa::bench::sample(ooc, options));
+      const double rate = bytes / stats.median * 1e-6;
+      if (options.csv)
+        std::printf("%s,%d,%d,%.6f,%.1f\n", names[v], n, chunk, stats.median,
+                    rate);
+      else
+        std::printf("%-8s %12d %10d %10.4f %10.1f\n", names[v], n, chunk,
+                    stats.median, rate);
+    }
+  }
+  unlink(a_path.c_str());
+  unlink(b_path.c_str());
+  unlink(out_path.c_str());
+  return 0;
+}
@@ -0,0 +1,256 @@
+// Copyright 2011 Patrick K. Notz
+//
+// STREAM through FastArray -- the Copy, Scale, Add and Triad kernels
+// of McCalpin's STREAM benchmark written as FastArray expressions and
+// evaluated serially and in parallel (fa::parallel, OpenMP), each with
+// regular cached stores and with streaming (non-temporal) stores.
+// Bandwidth uses STREAM's byte counts and best-of-repetitions time,
+// and is reported next to hand-written loops over the same arrays,
+// which are the achievable peak through this compiler, and next to
+// the nominal hardware peak when one is given with --peak=GB/s.
+// --numa allocates the arrays with fa::NumaAllocator, placing each
+// thread's part on its own NUMA node; otherwise they come from
+// fa::default_allocator() and are placed by the serial fill.
+// Also accepts the fa_bench options; the default size is 2^24.
+//
+#include <FastArray.hpp>
+#include <fa_bench.hpp>
+#include <fa_numa.hpp>
+#include <fa_parallel.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+const fa::ScalarT SCALAR = 3.0;
+
+struct Arrays {
+  // a NumaAllocator places the pages itself, so the fills can be serial
+  Arrays(const fa::IndexT n, fa::Allocator* allocator)
+    : a(n, allocator),
+      b(n, allocator),
+      c(n, allocator) {
+    a = 1.0;
+    b = 2.0;
+    c = 0.0;
+  }
+  fa::FastArray a, b, c;
+};
+
+//
+// How a kernel is evaluated; each variant provides
+// assign(lhs, expr)
+//
+struct serial {
+  static const char* name() { return "serial"; }
+  template <class T>
+  static void assign(fa::FastArray& lhs, const T& rhs) {
+    lhs.evaluate<fa::assign_op>(rhs, 0, lhs.size());
+  }
+};
+
+struct serial_streaming {
+  static const char* name() { return "serial-stream"; }
+  template <class T>
+  static void assign(fa::FastArray& lhs, const T& rhs) {
+    fa::streaming(lhs) = rhs;
+  }
+};
+
+struct parallel {
+  static const char* name() { return "parallel"; }
+  template <class T>
+  static void assign(fa::FastArray& lhs, const T& rhs) {
+    fa::parallel(lhs).evaluate<fa::assign_op>(rhs);
+  }
+};
+
+struct parallel_streaming {
+  static const char* name() { return "parallel-stream"; }
+  template <class T>
+  static void assign(fa::FastArray& lhs, const T& rhs) {
+    fa::parallel(lhs).stream(rhs);
+  }
+};
+
+//
+// The four STREAM kernels through FastArray
+//
+template <class Variant>
+struct copy {
+  explicit copy(Arrays* w) : m_w(w) {}
+  void operator()() const {
+    Variant::assign(m_w->c, fa::term<fa::FastArray>(m_w->a));
+  }
+  Arrays* m_w;
+};
+
+template <class Variant>
+struct scale {
+  explicit scale(Arrays* w) : m_w(w) {}
+  void operator()() const {
+    Variant::assign(m_w->b, SCALAR * m_w->c);
+  }
+  Arrays* m_w;
+};
+
+template <class Variant>
+struct add {
+  explicit add(Arrays* w) : m_w(w) {}
+  void operator()() const {
+    Variant::assign(m_w->c, m_w->a + m_w->b);
+  }
+  Arrays* m_w;
+};
+
+template <class Variant>
+struct triad {
+  explicit triad(Arrays* w) : m_w(w) {}
+  void operator()() const {
+    Variant::assign(m_w->a, m_w->b + SCALAR * m_w->c);
+  }
+  Arrays* m_w;
+};
+
+//
+// The same kernels as hand-written loops, serial or parallel
+//
+struct hand {
+  hand(Arrays* w, const int kernel, const bool threaded)
+    : m_w(w),
+      m_kernel(kernel),
+      m_threaded(threaded) {}
+  void operator()() const {
+    const fa::IndexT n = m_w->a.size();
+    fa::ScalarT* FA_RESTRICT a = m_w->a.data();
+    fa::ScalarT* FA_RESTRICT b = m_w->b.data();
+    fa::ScalarT* FA_RESTRICT c = m_w->c.data();
+    switch (m_kernel) {
+      case 0:
+#pragma omp parallel for if(m_threaded) schedule(static)
+        for (fa::IndexT i = 0; i < n; ++i)
+          c[i] = a[i];
+        break;
+      case 1:
+#pragma omp parallel for if(m_threaded) schedule(static)
+        for (fa::IndexT i = 0; i < n; ++i)
+          b[i] = SCALAR * c[i];
+        break;
+      case 2:
+#pragma omp parallel for if(m_threaded) schedule(static)
+        for (fa::IndexT i = 0; i < n; ++i)
+          c[i] = a[i] + b[i];
+        break;
+      default:
+#pragma omp parallel for if(m_threaded) schedule(static)
+        for (fa::IndexT i = 0; i < n; ++i)
+          a[i] = b[i] + SCALAR * c[i];
+        break;
+    }
+  }
+  Arrays* m_w;
+  int m_kernel;
+  bool m_threaded;
+};
+
+// STREAM's names and arrays moved per element
+const char* const KERNELS[] = { "Copy", "Scale", "Add", "Triad" };
+const int KERNEL_ARRAYS[] = { 2, 2, 3, 3 };
+
+template <class F>
+double best_time(F f, const fa::bench::Options& options) {
+  return fa::bench::summarize(fa::bench::sample(f, options)).min;
+}
+
+template <class Variant>
+double kernel_time(const int kernel, Arrays* w,
+                   const fa::bench::Options& options) {
+  switch (kernel) {
+    case 0: return best_time(copy<Variant>(w), options);
+    case 1: return best_time(scale<Variant>(w), options);
+    case 2: return best_time(add<Variant>(w), options);
+    default: return best_time(triad<Variant>(w), options);
+  }
+}
+
+template <class Variant>
+void report(const int kernel, Arrays* w, const double hand_rate,
+            const double peak, const fa::bench::Options& options) {
+  const double bytes =
+      KERNEL_ARRAYS[kernel] * sizeof(fa::ScalarT) * double(w->a.size());
+  const double rate = bytes / kernel_time<Variant>(kernel, w, options) * 1e-9;
+  if (options.csv) {
+    std::printf("%s,%s,%d,%.3f,%.3f,%.1f", KERNELS[kernel], Variant::name(),
+                w->a.size(), rate, hand_rate, 100 * rate / hand_rate);
+    if (peak > 0)
+      std::printf(",%.1f", 100 * rate / peak);
+    std::printf("\n");
+  } else {
+    std::printf("%-6s %-16s %10d %9.2f %9.2f %7.1f%%", KERNELS[kernel],
+                Variant::name(), w->a.size(), rate, hand_rate,
+                100 * rate / hand_rate);
+    if (peak > 0)
+      std::printf(" %7.1f%%", 100 * rate / peak);
+    std::printf("\n");
+  }
+}
+
+}  // namespace
+
+int main(int argc, char * argv[]) {
+  double peak = 0;
+  bool numa = false;
+  std::vector<char*> args;
+  for (int i = 0; i < argc; ++i) {
+    if (std::strncmp(argv[i], "--peak=", 7) == 0)
+      peak = std::atof(argv[i] + 7);
+    else if (std::strcmp(argv[i], "--numa") == 0)
+      numa = true;
+    else
+      args.push_back(argv[i]);
+  }
+  fa::bench::Options options;
+  options.sizes.assign(1, 1 << 24);
+  if (!fa::bench::parse_options(static_cast<int>(args.size()), &args[0],
+                                &options))
+    return 1;
+
+  if (!options.csv) {
+    std::printf("threads %d, LLC threshold %.1f MiB, %s allocation",
+                fa::num_threads(), fa::streaming_threshold() / 1048576.0,
+                numa ? "NUMA" : "default");
+    if (peak > 0)
+      std::printf(", hardware peak %.2f GB/s", peak);
+    std::printf("\n%-6s %-16s %10s %9s %9s %8s", "kernel", "variant", "size",
+                "GB/s", "hand GB/s", "%hand");
+    if (peak > 0)
+      std::printf(" %8s", "%peak");
+    std::printf("\n");
+  } else {
+    std::printf("kernel,variant,size,GB_per_s,hand_GB_per_s,percent_hand%s\n",
+                peak > 0 ? ",percent_peak" : "");
+  }
+  fa::NumaAllocator numa_allocator;
+  for (size_t s = 0; s < options.sizes.size(); ++s) {
+    Arrays w(options.sizes[s],
+             numa ? &numa_allocator : fa::default_allocator());
+    const double array_bytes = sizeof(fa::ScalarT) * double(w.a.size());
+    for (int k = 0; k < 4; ++k) {
+      if (std::string(KERNELS[k]).find(options.filter) == std::string::npos)
+        continue;
+      const double bytes = KERNEL_ARRAYS[k] * array_bytes;
+      const double serial_hand =
+          bytes / best_time(hand(&w, k, false), options) * 1e-9;
+      const double parallel_hand =
+          bytes / best_time(hand(&w, k, true), options) * 1e-9;
+      report<serial>(k, &w, serial_hand, peak, options);
+      report<serial_streaming>(k, &w, serial_hand, peak, options);
+      report<parallel>(k, &w, parallel_hand, peak, options);
+      report<parallel_streaming>(k, &w, parallel_hand, peak, options);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,97 @@
+// Copyright 2011 Patrick K. Notz
+//
+// Throughput of every operator, math node and assignment variant,
+// reported in GB/s and elements/s across cache levels, or placed on
+// a roofline of the machine with --roofline. Run with --help for
+// options.
+//
+#include <FastArray.hpp>
+#include <fa_bench.hpp>
+#include <fa_block.hpp>
+#include <tuple>
+
+namespace {
+
+// Sink for reduction results so they are not optimized away
+volatile fa::ScalarT reduction_sink;
+
+// Sum of an expression, the way reductions are written against
+// term<> today
+template <class T>
+fa::ScalarT sum(const T& expr, const fa::IndexT n) {
+  const fa::term<T> t(expr);
+  fa::ScalarT s = 0;
+  for (fa::IndexT i = 0; i < n; ++i)
+    s += t[i];
+  return s;
+}
+
+}  // namespace
+
+// Binary operators
+FA_BENCHMARK_EXPR(plus,            a + b);
+FA_BENCHMARK_EXPR(minus,           a - b);
+FA_BENCHMARK_EXPR(multiply,        a * b);
+FA_BENCHMARK_EXPR(divide,          a / b);
+FA_BENCHMARK_EXPR(plus_scalar,     a + 2.0);
+FA_BENCHMARK_EXPR(multiply_scalar, 2.0 * a);
+
+// Unary operators
+FA_BENCHMARK_EXPR(unary_minus,     -a);
+FA_BENCHMARK_EXPR(unary_plus,      +a);
+
+// Math nodes
+FA_BENCHMARK_EXPR(math_exp,        exp(a));
+FA_BENCHMARK_EXPR(math_log,        log(a));
+FA_BENCHMARK_EXPR(math_log10,      log10(a));
+FA_BENCHMARK_EXPR(math_sqrt,       sqrt(a));
+FA_BENCHMARK_EXPR(math_cos,        cos(a));
+FA_BENCHMARK_EXPR(math_sin,        sin(a));
+FA_BENCHMARK_EXPR(math_tan,        tan(a));
+FA_BENCHMARK_EXPR(math_acos,       acos(a));
+FA_BENCHMARK_EXPR(math_asin,       asin(a));
+FA_BENCHMARK_EXPR(math_atan,       atan(a));
+FA_BENCHMARK_EXPR(math_cosh,       cosh(a));
+FA_BENCHMARK_EXPR(math_sinh,       sinh(a));
+FA_BENCHMARK_EXPR(math_tanh,       tanh(a));
+FA_BENCHMARK_EXPR(math_abs,        abs(a));
+FA_BENCHMARK_EXPR(math_fabs,       fabs(a));
+FA_BENCHMARK_EXPR(math_pow,        pow(a, b));
+FA_BENCHMARK_EXPR(math_pow_scalar, pow(a, 2.5));
+FA_BENCHMARK_EXPR(math_max,        max(a, b));
+FA_BENCHMARK_EXPR(math_min,        min(a, b));
+FA_BENCHMARK_EXPR(math_atan2,      atan2(a, b));
+
+// Composite expressions
+FA_BENCHMARK_EXPR(several_binop,   a + b * c / (d + 13.0));
+FA_BENCHMARK_EXPR(kitchen_sink,
+                  log10(exp(a) + cos(b) * pow(c, 2.5) / (-d + 13.0)));
+FA_BENCHMARK_EXPR(map_axpy,
+                  map([](double x, double y) { return 2.0 * x + y; }, a, b));
+
+// Reductions
+FA_BENCHMARK(reduce_sum,      1, reduction_sink = sum(a, a.size()));
+FA_BENCHMARK(reduce_dot,      2, reduction_sink = sum(a * b, a.size()));
+FA_BENCHMARK(reduce_norm2,    1,
+             reduction_sink = sum(a * a, a.size()));
+
+// Assignment variants
+FA_BENCHMARK(assign_scalar,   1, out = 1.0);
+FA_BENCHMARK(assign_copy,     2, out = a);
+FA_BENCHMARK(assign_expr,     2, out = a * 1.0);
+FA_BENCHMARK(assign_streaming, 3, fa::streaming(out) = a + b);
+FA_BENCHMARK(assign_plus,     3, out += fa::term<fa::FastArray>(a));
+FA_BENCHMARK(assign_minus,    3, out -= fa::term<fa::FastArray>(a));
+// paired so that out neither underflows nor overflows across calls
+FA_BENCHMARK(assign_multiply_divide, 6,
+             out *= fa::term<fa::FastArray>(a);
+             out /= fa::term<fa::FastArray>(a));
+FA_BENCHMARK(assign_tie,      4,
+             fa::tie(out, d) = std::make_tuple(a + b, a - b));
+FA_BENCHMARK(assign_deferred_block, 5,
+             fa::DeferredBlock block;
+             block.assign(out, a + b).assign(d, out * a).run());
+
+int main(int argc, char * argv[]) {
+  return fa::bench::run_registered(argc, argv);
+}
@@ -0,0 +1,48 @@
+// Copyright 2011 Patrick K. Notz
+#include <fa_alloc.hpp>
+
+namespace fa {
+namespace alloc {
+
+namespace detail {
+
+std::atomic<uint64_t> allocations(0);
+std::atomic<uint64_t> reallocations(0);
+std::atomic<uint64_t> deallocations(0);
+std::atomic<uint64_t> copies(0);
+std::atomic<uint64_t> bytes_live(0);
+std::atomic<uint64_t> peak_bytes(0);
+
+}  // namespace detail
+
+Counts counts() {
+  Counts c;
+  c.allocations = detail::allocations.load(std::memory_order_relaxed);
+  c.reallocations = detail::reallocations.load(std::memory_order_relaxed);
+  c.deallocations = detail::deallocations.load(std::memory_order_relaxed);
+  c.copies = detail::copies.load(std::memory_order_relaxed);
+  c.bytes_live = detail::bytes_live.load(std::memory_order_relaxed);
+  c.peak_bytes = detail::peak_bytes.load(std::memory_order_relaxed);
+  return c;
+}
+
+void reset() {
+  detail::allocations.store(0, std::memory_order_relaxed);
+  detail::reallocations.store(0, std::memory_order_relaxed);
+  detail::deallocations.store(0, std::memory_order_relaxed);
+  detail::copies.store(0, std::memory_order_relaxed);
+  detail::peak_bytes.store(detail::bytes_live.load(std::memory_order_relaxed),
+                           std::memory_order_relaxed);
+}
+
+void write(std::ostream& os, const Counts& c) {
+  os << "allocations " << c.allocations
+     << " reallocations " << c.reallocations
+     << " deallocations " << c.deallocations
+     << " copies " << c.copies
+     << " bytes_live " << c.bytes_live
+     << " peak_bytes " << c.peak_bytes << "\n";
+}
+
+}  // namespace alloc
+}  // namespace fa
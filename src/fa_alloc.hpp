@@ -0,0 +1,75 @@
+// Copyright 2011 Patrick K. Notz
+#ifndef SRC_FA_ALLOC_HPP_
+#define SRC_FA_ALLOC_HPP_
+
+#include <stdint.h>
+#include <atomic>
+#include <ostream>
+
+namespace fa {
+namespace alloc {
+
+//
+// Allocation counters. Compile with -DFA_ALLOCATION_COUNTERS to have
+// every FastArray count its buffer allocations, the reallocations
+// made by resize() and its element copies (copy construction, copy
+// assignment, and copy-on-write arrays taking a shared buffer's
+// elements; sharing itself copies nothing), and to track the bytes
+// live and their high-water mark. Build the library with the same
+// definitions, as falib-instrumented is. Counters are process-wide
+// and updated with relaxed atomics, so they are safe to use from
+// several threads.
+//
+struct Counts {
+  uint64_t allocations;    // buffers allocated, including reallocations
+  uint64_t reallocations;  // buffers replaced by a growing resize()
+  uint64_t deallocations;  // buffers freed
+  uint64_t copies;         // element copies, see above
+  uint64_t bytes_live;     // bytes currently allocated
+  uint64_t peak_bytes;     // high-water mark of bytes_live
+};
+
+Counts counts();
+
+// Zeroes the event counts and restarts the high-water mark from the
+// bytes currently live
+void reset();
+
+void write(std::ostream& os, const Counts& c);
+
+namespace detail {
+
+extern std::atomic<uint64_t> allocations;
+extern std::atomic<uint64_t> reallocations;
+extern std::atomic<uint64_t> deallocations;
+extern std::atomic<uint64_t> copies;
+extern std::atomic<uint64_t> bytes_live;
+extern std::atomic<uint64_t> peak_bytes;
+
+}  // namespace detail
+
+inline void on_allocate(const uint64_t bytes, const bool replaces) {
+  detail::allocations.fetch_add(1, std::memory_order_relaxed);
+  if (replaces)
+    detail::reallocations.fetch_add(1, std::memory_order_relaxed);
+  const uint64_t live =
+      detail::bytes_live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  uint64_t peak = detail::peak_bytes.load(std::memory_order_relaxed);
+  while (live > peak &&
+         !detail::peak_bytes.compare_exchange_weak(
+             peak, live, std::memory_order_relaxed)) {}
+}
+
+inline void on_deallocate(const uint64_t bytes) {
+  detail::deallocations.fetch_add(1, std::memory_order_relaxed);
+  detail::bytes_live.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+inline void on_copy() {
+  detail::copies.fetch_add(1, std::memory_order_relaxed);
+}
+
+}  // namespace alloc
+}  // namespace fa
+
+#endif  // SRC_FA_ALLOC_HPP_
@@ -0,0 +1,75 @@
+// Copyright 2011 Patrick K. Notz
+#include <fa_arena.hpp>
+#include <stdlib.h>
+#include <new>
+
+namespace fa {
+
+namespace {
+
+const size_t ALIGNMENT = 64;
+const size_t NONE = static_cast<size_t>(-1);
+
+size_t aligned(const size_t bytes) {
+  return (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+}  // namespace
+
+// Precedes the elements of each array, one alignment unit long
+struct Arena::Block {
+  size_t previous;  // offset of the block before, or NONE
+  size_t end;       // offset just past the elements
+  bool released;
+};
+
+Arena::Arena(const size_t bytes)
+  : m_base(0),
+    m_capacity(aligned(bytes)),
+    m_top(0),
+    m_last(NONE),
+    m_high_water(0) {
+  static_assert(sizeof(Block) <= ALIGNMENT, "Block must fit an alignment unit");
+  void* base;
+  if (::posix_memalign(&base, ALIGNMENT, m_capacity) != 0)
+    throw std::bad_alloc();
+  m_base = static_cast<char*>(base);
+}
+
+// Arrays still using the arena would dangle; like any allocator it
+// must outlive them
+Arena::~Arena() {
+  ::free(m_base);
+}
+
+Arena::Block* Arena::block(const size_t offset) const {
+  return reinterpret_cast<Block*>(m_base + offset);
+}
+
+ScalarT* Arena::allocate(const IndexT n) {
+  const size_t bytes =
+      ALIGNMENT + aligned(static_cast<size_t>(n) * sizeof(ScalarT));
+  if (bytes > m_capacity - m_top)
+    throw std::bad_alloc();
+  Block* b = block(m_top);
+  b->previous = m_last;
+  b->end = m_top + bytes;
+  b->released = false;
+  m_last = m_top;
+  m_top = b->end;
+  if (m_top > m_high_water)
+    m_high_water = m_top;
+  return reinterpret_cast<ScalarT*>(m_base + m_last + ALIGNMENT);
+}
+
+void Arena::deallocate(ScalarT* p, const IndexT) {
+  reinterpret_cast<Block*>(reinterpret_cast<char*>(p) - ALIGNMENT)
+      ->released = true;
+  // pop released blocks off the top
+  while (m_last != NONE && block(m_last)->released) {
+    m_top = m_last;
+    m_last = block(m_last)->previous;
+  }
+}
+
+}  // namespace fa
@@ -0,0 +1,68 @@
+// Copyright 2011 Patrick K. Notz
+#ifndef SRC_FA_ARENA_HPP_
+#define SRC_FA_ARENA_HPP_
+
+#include <FastArray.hpp>
+#include <cstddef>
+
+namespace fa {
+
+//
+// Arena - scratch storage for temporaries that a loop materializes
+// every iteration, e.g. one used twice. The arena reserves one
+// 64-byte-aligned region up front and hands out its arrays by bumping
+// a pointer; an array's storage is released when the array is freed,
+// and the region shrinks back as soon as the most recent allocations
+// are released, so arrays that live in nested scopes reuse the same
+// memory every time around and the steady state never calls the heap:
+//
+//   fa::Arena scratch(64 << 20);
+//   for (int step = 0; step < steps; ++step) {
+//     fa::FastArray flux(n, &scratch), residual(n, &scratch);
+//     flux = u * v;
+//     residual = flux - source;
+//     u = u + dt * residual + dt * dt * flux;
+//   }
+//
+// Arrays may be freed in any order; out-of-order storage is reclaimed
+// when everything allocated after it is released too. Allocations
+// that do not fit throw std::bad_alloc rather than fall back to the
+// heap; high_water() tells how large the arena needs to be.
+//
+class Arena : public Allocator {
+ public:
+  explicit Arena(const size_t bytes);
+  ~Arena();
+
+  ScalarT* allocate(const IndexT n);
+  void deallocate(ScalarT* p, const IndexT n);
+
+  // Bytes reserved, in use (including per-array bookkeeping), and
+  // the most ever in use
+  size_t capacity() const {
+    return m_capacity;
+  }
+  size_t used() const {
+    return m_top;
+  }
+  size_t high_water() const {
+    return m_high_water;
+  }
+
+ private:
+  Arena(const Arena&);
+  Arena& operator=(const Arena&);
+
+  struct Block;
+  Block* block(const size_t offset) const;
+
+  char* m_base;
+  size_t m_capacity;
+  size_t m_top;          // offset of the first free byte
+  size_t m_last;         // offset of the most recent block, or NONE
+  size_t m_high_water;
+};
+
+}  // namespace fa
+
+#endif  // SRC_FA_ARENA_HPP_
@@ -0,0 +1,295 @@
+// Copyright 2011 Patrick K. Notz
+#include <fa_bench.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace fa {
+namespace bench {
+
+double now() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Operands::Operands(const IndexT n)
+  : a(n), b(n), c(n), d(n), out(n, 0.0) {
+  for (IndexT i = 0; i < n; ++i) {
+    a[i] = 0.1 + 0.8 * ((i * 7) % 97) / 97.0;
+    b[i] = 0.1 + 0.8 * ((i * 11) % 89) / 89.0;
+    c[i] = 0.1 + 0.8 * ((i * 13) % 83) / 83.0;
+    d[i] = 0.1 + 0.8 * ((i * 17) % 79) / 79.0;
+  }
+}
+
+std::vector<Benchmark>& registry() {
+  static std::vector<Benchmark> benchmarks;
+  return benchmarks;
+}
+
+Registrar::Registrar(const char* name, const int arrays, Kernel kernel) {
+  Benchmark benchmark = { name, arrays, -1, kernel };
+  registry().push_back(benchmark);
+}
+
+Registrar::Registrar(const char* name, const cost& expr_cost,
+                     Kernel kernel) {
+  // operands read plus the destination written
+  Benchmark benchmark = { name, expr_cost.arrays + 1, expr_cost.flops,
+                          kernel };
+  registry().push_back(benchmark);
+}
+
+Stats summarize(std::vector<double> samples) {
+  Stats stats = { 0, 0, 0, 0 };
+  if (samples.empty())
+    return stats;
+  std::sort(samples.begin(), samples.end());
+  const size_t n = samples.size();
+  stats.min = samples.front();
+  stats.median = n % 2 ? samples[n / 2]
+                       : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+  for (size_t i = 0; i < n; ++i)
+    stats.mean += samples[i];
+  stats.mean /= n;
+  for (size_t i = 0; i < n; ++i)
+    stats.stddev += (samples[i] - stats.mean) * (samples[i] - stats.mean);
+  stats.stddev = n > 1 ? std::sqrt(stats.stddev / (n - 1)) : 0;
+  return stats;
+}
+
+Options::Options()
+  : repetitions(5),
+    min_time(0.02),
+    csv(false),
+    roofline(false) {
+  sizes.push_back(1 << 9);   // 4 KiB per array: L1
+  sizes.push_back(1 << 14);  // 128 KiB: L2
+  sizes.push_back(1 << 19);  // 4 MiB: last-level cache
+  sizes.push_back(1 << 24);  // 128 MiB: DRAM
+}
+
+namespace {
+
+bool starts_with(const char* arg, const char* prefix, const char** value) {
+  const size_t len = std::strlen(prefix);
+  if (std::strncmp(arg, prefix, len) != 0)
+    return false;
+  *value = arg + len;
+  return true;
+}
+
+}  // namespace
+
+bool parse_options(int argc, char* argv[], Options* options) {
+  for (int i = 1; i < argc; ++i) {
+    const char* value = 0;
+    if (starts_with(argv[i], "--filter=", &value)) {
+      options->filter = value;
+    } else if (starts_with(argv[i], "--repetitions=", &value)) {
+      options->repetitions = std::max(1, std::atoi(value));
+    } else if (starts_with(argv[i], "--min-time=", &value)) {
+      options->min_time = std::atof(value);
+    } else if (starts_with(argv[i], "--sizes=", &value)) {
+      options->sizes.clear();
+      for (const char* p = value; *p; ) {
+        options->sizes.push_back(std::atoi(p));
+        p = std::strchr(p, ',');
+        if (!p)
+          break;
+        ++p;
+      }
+    } else if (std::strcmp(argv[i], "--csv") == 0) {
+      options->csv = true;
+    } else if (std::strcmp(argv[i], "--roofline") == 0) {
+      options->roofline = true;
+    } else {
+      std::fprintf(stderr,
+                   "usage: %s [--filter=substring] [--repetitions=N]"
+                   " [--min-time=seconds] [--sizes=n1,n2,...] [--csv]"
+                   " [--roofline]\n",
+                   argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+void report_header(const Options& options) {
+  if (options.csv) {
+    std::printf("name,size,median_s,min_s,stddev_s,GB_per_s,elements_per_s\n");
+  } else {
+    std::printf("%-28s %10s %12s %8s %10s %12s\n", "benchmark", "size",
+                "median(ns)", "cv(%)", "GB/s", "Melem/s");
+  }
+}
+
+void report(const Options& options, const std::string& name,
+            const IndexT size, const double bytes, const double elements,
+            const Stats& stats) {
+  const double gbs = bytes / stats.median * 1e-9;
+  const double eps = elements / stats.median;
+  if (options.csv) {
+    std::printf("%s,%d,%.9g,%.9g,%.9g,%.6g,%.6g\n", name.c_str(), size,
+                stats.median, stats.min, stats.stddev, gbs, eps);
+  } else {
+    const double cv = stats.mean > 0 ? 100 * stats.stddev / stats.mean : 0;
+    std::printf("%-28s %10d %12.1f %8.2f %10.2f %12.1f\n", name.c_str(),
+                size, stats.median * 1e9, cv, gbs, eps * 1e-6);
+  }
+  std::fflush(stdout);
+}
+
+namespace {
+
+struct triad {
+  explicit triad(Operands* ops) : m_ops(ops) {}
+  void operator()() const { m_ops->out = m_ops->a + 3.0 * m_ops->b; }
+  Operands* m_ops;
+};
+
+// 32 independent multiply-add chains, enough to fill the vector
+// registers and hide the latency of each operation
+const int FMA_CHAINS = 32;
+const int FMA_STEPS = 4096;
+
+struct multiply_add {
+  explicit multiply_add(double* x) : m_x(x) {}
+  void operator()() const {
+    double v[FMA_CHAINS];
+    for (int k = 0; k < FMA_CHAINS; ++k)
+      v[k] = m_x[k];
+    for (int step = 0; step < FMA_STEPS; ++step)
+      for (int k = 0; k < FMA_CHAINS; ++k)
+        v[k] = v[k] * 0.999999 + 1e-7;
+    for (int k = 0; k < FMA_CHAINS; ++k)
+      m_x[k] = v[k];
+  }
+  double* m_x;
+};
+
+volatile double peak_sink;
+
+const char* bound_name(const double intensity, const Peaks& peaks) {
+  return intensity * peaks.bytes_per_second < peaks.flops_per_second
+             ? "memory" : "compute";
+}
+
+}  // namespace
+
+Peaks measure_peaks(const Options& options) {
+  Peaks peaks;
+  // well beyond any last-level cache
+  const IndexT n = 1 << 24;
+  {
+    Operands ops(n);
+    const Stats stats = summarize(sample(triad(&ops), options));
+    peaks.bytes_per_second = 3.0 * sizeof(ScalarT) * n / stats.min;
+  }
+  double x[FMA_CHAINS];
+  for (int k = 0; k < FMA_CHAINS; ++k)
+    x[k] = 1.0 + k;
+  const Stats stats = summarize(sample(multiply_add(x), options));
+  peaks.flops_per_second = 2.0 * FMA_CHAINS * FMA_STEPS / stats.min;
+  // keep the kernel's results alive
+  for (int k = 0; k < FMA_CHAINS; ++k)
+    peak_sink += x[k];
+  return peaks;
+}
+
+void report_roofline_header(const Options& options, const Peaks& peaks) {
+  if (options.csv) {
+    std::printf("# peak_GB_per_s=%.3f peak_GFLOP_per_s=%.3f\n",
+                peaks.bytes_per_second * 1e-9, peaks.flops_per_second * 1e-9);
+    std::printf("name,size,flops_per_element,bytes_per_element,"
+                "intensity,GFLOP_per_s,GB_per_s,attainable_GFLOP_per_s,"
+                "fraction_of_roof,bound\n");
+  } else {
+    std::printf("peak DRAM bandwidth %.2f GB/s, peak %.2f GFLOP/s,"
+                " ridge at %.3f flop/byte\n"
+                "(cache-resident sizes can exceed the DRAM roof)\n",
+                peaks.bytes_per_second * 1e-9, peaks.flops_per_second * 1e-9,
+                peaks.flops_per_second / peaks.bytes_per_second);
+    std::printf("%-22s %10s %6s %6s %8s %9s %8s %10s %7s %8s\n",
+                "benchmark", "size", "flop", "byte", "flop/B", "GFLOP/s",
+                "GB/s", "roof", "%roof", "bound");
+  }
+}
+
+void report_roofline(const Options& options, const Peaks& peaks,
+                     const Benchmark& benchmark, const IndexT size,
+                     const Stats& stats) {
+  const double bytes = static_cast<double>(benchmark.arrays) * sizeof(ScalarT);
+  const double intensity = benchmark.flops / bytes;
+  const double gflops = benchmark.flops * size / stats.median * 1e-9;
+  const double gbs = bytes * size / stats.median * 1e-9;
+  const double roof = std::min(peaks.flops_per_second,
+                               intensity * peaks.bytes_per_second) * 1e-9;
+  const double fraction = roof > 0 ? gflops / roof : 0;
+  if (options.csv) {
+    std::printf("%s,%d,%d,%.0f,%.6g,%.6g,%.6g,%.6g,%.4f,%s\n",
+                benchmark.name.c_str(), size, benchmark.flops, bytes,
+                intensity, gflops, gbs, roof, fraction,
+                bound_name(intensity, peaks));
+  } else {
+    std::printf("%-22s %10d %6d %6.0f %8.3f %9.3f %8.2f %10.3f %6.1f%% %8s\n",
+                benchmark.name.c_str(), size, benchmark.flops, bytes,
+                intensity, gflops, gbs, roof, 100 * fraction,
+                bound_name(intensity, peaks));
+  }
+  std::fflush(stdout);
+}
+
+namespace {
+
+struct run_kernel {
+  run_kernel(Kernel kernel, Operands* ops) : m_kernel(kernel), m_ops(ops) {}
+  void operator()() const { m_kernel(*m_ops); }
+  Kernel m_kernel;
+  Operands* m_ops;
+};
+
+}  // namespace
+
+int run_registered(int argc, char* argv[]) {
+  Options options;
+  if (!parse_options(argc, argv, &options))
+    return 1;
+  Peaks peaks = { 0, 0 };
+  if (options.roofline) {
+    peaks = measure_peaks(options);
+    report_roofline_header(options, peaks);
+  } else {
+    report_header(options);
+  }
+  const std::vector<Benchmark>& benchmarks = registry();
+  for (size_t s = 0; s < options.sizes.size(); ++s) {
+    const IndexT n = options.sizes[s];
+    Operands ops(n);
+    for (size_t k = 0; k < benchmarks.size(); ++k) {
+      const Benchmark& bm = benchmarks[k];
+      if (bm.name.find(options.filter) == std::string::npos)
+        continue;
+      // the roofline needs a flop count from the expression tree
+      if (options.roofline && bm.flops <= 0)
+        continue;
+      const Stats stats =
+          summarize(sample(run_kernel(bm.kernel, &ops), options));
+      if (options.roofline)
+        report_roofline(options, peaks, bm, n, stats);
+      else
+        report(options, bm.name, n,
+               static_cast<double>(bm.arrays) * sizeof(ScalarT) * n, n,
+               stats);
+    }
+  }
+  return 0;
+}
+
+}  // namespace bench
+}  // namespace fa
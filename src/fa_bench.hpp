@@ -0,0 +1,159 @@
+// Copyright 2011 Patrick K. Notz
+#ifndef SRC_FA_BENCH_HPP_
+#define SRC_FA_BENCH_HPP_
+
+#include <FastArray.hpp>
+#include <string>
+#include <vector>
+
+namespace fa {
+namespace bench {
+
+// Monotonic wall clock, in seconds
+double now();
+
+//
+// Operands - the arrays every registered benchmark works on. Inputs
+// hold values in (0.1, 0.9) so that every math node stays in its
+// domain.
+//
+struct Operands {
+  explicit Operands(const IndexT n);
+  FastArray a, b, c, d, out;
+};
+
+typedef void (*Kernel)(Operands& ops);
+
+struct Benchmark {
+  std::string name;
+  int arrays;  // arrays streamed per element (reads + writes)
+  int flops;   // per element, or -1 if not known statically
+  Kernel kernel;
+};
+
+std::vector<Benchmark>& registry();
+
+struct Registrar {
+  Registrar(const char* name, const int arrays, Kernel kernel);
+  // out = expr benchmarks, with the cost derived from the expression
+  Registrar(const char* name, const cost& expr_cost, Kernel kernel);
+};
+
+//
+// Repetition statistics of per-call times, in seconds
+//
+struct Stats {
+  double min;
+  double median;
+  double mean;
+  double stddev;
+};
+
+Stats summarize(std::vector<double> samples);
+
+struct Options {
+  Options();
+  std::string filter;
+  int repetitions;
+  double min_time;
+  std::vector<IndexT> sizes;
+  bool csv;
+  bool roofline;
+};
+
+// Parses --filter=, --repetitions=, --min-time=, --sizes=n1,n2,...,
+// --csv and --roofline; returns false (after printing usage) on bad
+// arguments
+bool parse_options(int argc, char* argv[], Options* options);
+
+//
+// Times f: each repetition calls f until min_time has elapsed and
+// records the average time per call
+//
+template <class F>
+std::vector<double> sample(F f, const Options& options) {
+  f();  // warm up caches and page in the operands
+  std::vector<double> samples;
+  for (int r = 0; r < options.repetitions; ++r) {
+    int calls = 0;
+    const double t0 = now();
+    double elapsed = 0;
+    do {
+      f();
+      ++calls;
+      elapsed = now() - t0;
+    } while (elapsed < options.min_time);
+    samples.push_back(elapsed / calls);
+  }
+  return samples;
+}
+
+// Prints one result line; bytes and elements are per call
+void report(const Options& options, const std::string& name,
+            const IndexT size, const double bytes, const double elements,
+            const Stats& stats);
+
+void report_header(const Options& options);
+
+//
+// Machine peaks for the roofline model, measured with a triad over
+// DRAM-sized arrays and a register-resident multiply-add kernel
+//
+struct Peaks {
+  double bytes_per_second;
+  double flops_per_second;
+};
+
+Peaks measure_peaks(const Options& options);
+
+// Prints one roofline line for a benchmark with known flops
+void report_roofline(const Options& options, const Peaks& peaks,
+                     const Benchmark& benchmark, const IndexT size,
+                     const Stats& stats);
+
+void report_roofline_header(const Options& options, const Peaks& peaks);
+
+// Runs every registered benchmark matching options.filter
+int run_registered(int argc, char* argv[]);
+
+}  // namespace bench
+}  // namespace fa
+
+//
+// FA_BENCHMARK(name, arrays, statement) registers a benchmark; the
+// statement can use the operands a, b, c, d and out
+//
+#define FA_BENCH_OPERANDS(OPS) \
+  fa::FastArray& a = OPS.a; \
+  fa::FastArray& b = OPS.b; \
+  fa::FastArray& c = OPS.c; \
+  fa::FastArray& d = OPS.d; \
+  fa::FastArray& out = OPS.out; \
+  (void) a; (void) b; (void) c; (void) d; (void) out
+
+#define FA_BENCHMARK(NAME, ARRAYS, STATEMENT) \
+  static void fa_bench_##NAME(fa::bench::Operands& ops) { \
+    FA_BENCH_OPERANDS(ops); \
+    STATEMENT; \
+  } \
+  static fa::bench::Registrar fa_bench_registrar_##NAME( \
+      #NAME, ARRAYS, fa_bench_##NAME)
+
+//
+// FA_BENCHMARK_EXPR(name, expr) registers out = expr; the bytes and
+// flops per element come from the expression tree
+//
+#define FA_BENCHMARK_EXPR(NAME, EXPR) \
+  static void fa_bench_##NAME(fa::bench::Operands& ops) { \
+    FA_BENCH_OPERANDS(ops); \
+    out = EXPR; \
+  } \
+  static fa::cost fa_bench_cost_##NAME() { \
+    fa::bench::Operands ops(0); \
+    FA_BENCH_OPERANDS(ops); \
+    return fa::expression_cost(EXPR); \
+  } \
+  static fa::bench::Registrar fa_bench_registrar_##NAME( \
+      #NAME, fa_bench_cost_##NAME(), fa_bench_##NAME)
+
+#endif  // SRC_FA_BENCH_HPP_
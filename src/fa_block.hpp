@@ -0,0 +1,147 @@
+// Copyright 2011 Patrick K. Notz
+#ifndef SRC_FA_BLOCK_HPP_
+#define SRC_FA_BLOCK_HPP_
+
+#include <FastArray.hpp>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fa {
+
+//
+// DeferredBlock - records a sequence of assignments and executes
+// them strip-mined over cache-sized tiles. For each tile every
+// statement runs in order, so arrays written by one statement are
+// still in cache when later statements read them.
+//
+// Every term<> node is element-wise, so a statement that reads a
+// destination at the element it is computing only reads element j
+// where earlier statements have finished with element j, and the
+// tiled order gives the same result as running the statements one
+// after another. An operand that overlaps a destination out of step,
+// e.g. a FastArrayView one element into it, would read across tile
+// boundaries, so run() then executes the statements untiled, one
+// after another. The block requires all destinations to have the
+// same size.
+//
+// Expressions are stored by value, while FastArray operands are
+// held by reference; a recorded block can be run again (e.g. once
+// per timestep) and always sees the current array contents.
+//
+class DeferredBlock {
+ public:
+  // 2048 doubles (16 KiB) per array keeps a few dozen
+  // arrays' worth of tiles inside a typical L2 cache
+  static const IndexT default_tile_size = 2048;
+
+  explicit DeferredBlock(const IndexT tile_size = default_tile_size)
+    : m_tile_size(tile_size),
+      m_size(-1) {
+    if (tile_size <= 0)
+      throw std::invalid_argument(
+          "fa::DeferredBlock: tile size must be positive");
+  }
+
+  template <class T>
+  DeferredBlock& assign(FastArray& lhs, const T& rhs) {
+    if (m_size < 0)
+      m_size = lhs.size();
+    if (lhs.size() != m_size)
+      throw std::length_error(
+          "fa::DeferredBlock: all destinations must have the same size");
+    m_statements.push_back(
+        std::unique_ptr<statement>(new assignment<T>(lhs, rhs)));
+    return *this;
+  }
+
+  void run() const {
+    // destinations may have been resized since they were recorded
+    for (size_t s = 0; s < m_statements.size(); ++s)
+      if (m_statements[s]->size() != m_size)
+        throw std::length_error(
+            "fa::DeferredBlock: a destination was resized after assign()");
+    const IndexT n = std::max(m_size, 0);
+    const IndexT tile = tiled() ? m_tile_size : std::max(n, 1);
+    FA_INSTRUMENT(DeferredBlock, "block", &block_signature, n);
+    for (IndexT begin = 0; begin < n; begin += tile) {
+      const IndexT end = std::min(begin + tile, n);
+      for (size_t s = 0; s < m_statements.size(); ++s)
+        m_statements[s]->evaluate(begin, end);
+    }
+  }
+
+  void clear() {
+    m_statements.clear();
+    m_size = -1;
+  }
+
+  size_t num_statements() const {
+    return m_statements.size();
+  }
+
+  IndexT tile_size() const {
+    return m_tile_size;
+  }
+
+  // False if an operand reads a destination out of step, so that
+  // run() cannot tile; checked at run() since arrays may move
+  bool tiled() const {
+    for (size_t d = 0; d < m_statements.size(); ++d) {
+      const ScalarT* begin = m_statements[d]->destination();
+      const ScalarT* end = begin + m_statements[d]->size();
+      for (size_t s = 0; s < m_statements.size(); ++s)
+        if (m_statements[s]->shifted(begin, end))
+          return false;
+    }
+    return true;
+  }
+
+ private:
+  struct statement {
+    virtual ~statement() {}
+    virtual void evaluate(const IndexT begin, const IndexT end) const = 0;
+    virtual IndexT size() const = 0;
+    virtual const ScalarT* destination() const = 0;
+    virtual bool shifted(const ScalarT* begin, const ScalarT* end) const = 0;
+  };
+
+  template <class T>
+  struct assignment : statement {
+    assignment(FastArray& lhs, const T& rhs)
+      : m_lhs(lhs),
+        m_rhs(rhs) {}
+    void evaluate(const IndexT begin, const IndexT end) const {
+      m_lhs.evaluate<assign_op>(m_rhs, begin, end);
+    }
+    IndexT size() const {
+      return m_lhs.size();
+    }
+    // const access, so that a copy-on-write destination is not detached
+    const ScalarT* destination() const {
+      return static_cast<const FastArray&>(m_lhs).data();
+    }
+    bool shifted(const ScalarT* begin, const ScalarT* end) const {
+      return m_rhs.shifted(begin, end);
+    }
+    FastArray& m_lhs;
+    const term<T> m_rhs;
+  };
+
+  static std::string block_signature() {
+    return "DeferredBlock";
+  }
+
+  DeferredBlock(const DeferredBlock&);
+  DeferredBlock& operator=(const DeferredBlock&);
+
+  const IndexT m_tile_size;
+  IndexT m_size;
+  std::vector<std::unique_ptr<statement> > m_statements;
+};
+
+}  // namespace fa
+
+#endif  // SRC_FA_BLOCK_HPP_
@@ -0,0 +1,622 @@
+// Copyright 2011 Patrick K. Notz
+#include <fa_codec.hpp>
+#include <fa_io.hpp>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+namespace fa {
+namespace codec {
+
+namespace {
+
+enum {
+  PLANE_RAW = 0,
+  PLANE_CONSTANT = 1,
+  PLANE_RLE = 2
+};
+
+const size_t PLANES = sizeof(uint64_t);
+const size_t PLANE_HEADER = 1 + sizeof(uint32_t);
+
+// PackBits: a control byte c < 128 is followed by c + 1 literal bytes;
+// c >= 128 by one byte repeated c - 125 times
+const size_t MAX_LITERALS = 128;
+const size_t MIN_RUN = 3;
+const size_t MAX_RUN = 255 - 128 + MIN_RUN;
+
+void corrupt() {
+  throw io::io_error("corrupt compressed data");
+}
+
+// Length of the run of p[0] starting at p, at most max
+size_t run_length(const unsigned char* p, const size_t max) {
+  size_t k = 1;
+#if defined(__SSE2__)
+  const __m128i v = _mm_set1_epi8(static_cast<char>(p[0]));
+  for (; k + 16 <= max; k += 16) {
+    const __m128i x =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k));
+    const unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, v));
+    if (mask != 0xFFFF)
+      return k + __builtin_ctz(~mask);
+  }
+#endif
+  while (k < max && p[k] == p[0])
+    ++k;
+  return k;
+}
+
+// Start of the first run of MIN_RUN equal bytes in p[0, n), or n
+size_t next_run(const unsigned char* p, const size_t n) {
+  size_t k = 0;
+#if defined(__SSE2__)
+  for (; k + 18 <= n; k += 16) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k));
+    const __m128i b =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k + 1));
+    const __m128i c =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k + 2));
+    const unsigned mask = _mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(a, b), _mm_cmpeq_epi8(b, c)));
+    if (mask != 0)
+      return k + __builtin_ctz(mask);
+  }
+#endif
+  for (; k + MIN_RUN <= n; ++k)
+    if (p[k] == p[k + 1] && p[k] == p[k + 2])
+      return k;
+  return n;
+}
+
+// Codes n bytes of in into out, returning the coded length, or
+// capacity + 1 as soon as it would exceed capacity
+size_t rle_encode(const unsigned char* in, const size_t n, unsigned char* out,
+                  const size_t capacity) {
+  size_t length = 0;
+  size_t i = 0;
+  while (i < n) {
+    const size_t run = i + next_run(in + i, n - i);
+    while (i < run) {
+      const size_t count = std::min(run - i, MAX_LITERALS);
+      if (length + 1 + count > capacity)
+        return capacity + 1;
+      out[length++] = static_cast<unsigned char>(count - 1);
+      std::memcpy(out + length, in + i, count);
+      length += count;
+      i += count;
+    }
+    if (i == n)
+      break;
+    const size_t count = run_length(in + i, std::min(n - i, MAX_RUN));
+    if (length + 2 > capacity)
+      return capacity + 1;
+    out[length++] = static_cast<unsigned char>(128 + count - MIN_RUN);
+    out[length++] = in[i];
+    i += count;
+  }
+  return length;
+}
+
+void rle_decode(const unsigned char* in, const size_t length,
+                unsigned char* out, const size_t n) {
+  const unsigned char* const end = in + length;
+  size_t k = 0;
+  while (in < end) {
+    const unsigned c = *in++;
+    if (c < 128) {
+      const size_t count = c + 1;
+      if (count > static_cast<size_t>(end - in) || count > n - k)
+        corrupt();
+      std::memcpy(out + k, in, count);
+      in += count;
+      k += count;
+    } else {
+      const size_t count = c - 128 + MIN_RUN;
+      if (in == end || count > n - k)
+        corrupt();
+      std::memset(out + k, *in++, count);
+      k += count;
+    }
+  }
+  if (k != n)
+    corrupt();
+}
+
+// Per-thread working storage of one block
+struct scratch {
+  explicit scratch(const size_t n)
+    : words(n),
+      planes(PLANES * n),
+      escaped(n) {}
+  std::vector<uint64_t> words;
+  std::vector<unsigned char> planes;
+  std::vector<ScalarT> escaped;
+};
+
+// Largest encoding of a block of n elements: every plane raw
+size_t max_block_bytes(const size_t n) {
+  return PLANES * (PLANE_HEADER + n);
+}
+
+// Encodes the n elements at x into out, returning the bytes used
+size_t encode_block(const ScalarT* x, const size_t n, scratch* s,
+                    char* out) {
+  uint64_t previous = 0;
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t w;
+    std::memcpy(&w, x + i, sizeof(w));
+    s->words[i] = w ^ previous;
+    previous = w;
+  }
+  shuffle(&s->words[0], n, &s->planes[0]);
+
+  char* const headers = out;
+  size_t length = PLANES * PLANE_HEADER;
+  for (size_t j = 0; j < PLANES; ++j) {
+    const unsigned char* plane = &s->planes[j * n];
+    unsigned char* payload = reinterpret_cast<unsigned char*>(out + length);
+    unsigned char mode;
+    uint32_t bytes;
+    if (run_length(plane, n) == n) {
+      mode = PLANE_CONSTANT;
+      bytes = 1;
+      payload[0] = plane[0];
+    } else {
+      bytes = static_cast<uint32_t>(rle_encode(plane, n, payload, n - 1));
+      mode = PLANE_RLE;
+      if (bytes >= n) {
+        mode = PLANE_RAW;
+        bytes = static_cast<uint32_t>(n);
+        std::memcpy(payload, plane, n);
+      }
+    }
+    headers[j * PLANE_HEADER] = static_cast<char>(mode);
+    std::memcpy(headers + j * PLANE_HEADER + 1, &bytes, sizeof(bytes));
+    length += bytes;
+  }
+  return length;
+}
+
+void decode_block(const char* in, const size_t length, const size_t n,
+                  scratch* s, ScalarT* x) {
+  if (length < PLANES * PLANE_HEADER)
+    corrupt();
+  size_t offset = PLANES * PLANE_HEADER;
+  for (size_t j = 0; j < PLANES; ++j) {
+    const unsigned char mode =
+        static_cast<unsigned char>(in[j * PLANE_HEADER]);
+    uint32_t bytes;
+    std::memcpy(&bytes, in + j * PLANE_HEADER + 1, sizeof(bytes));
+    if (bytes > length - offset)
+      corrupt();
+    const unsigned char* payload =
+        reinterpret_cast<const unsigned char*>(in + offset);
+    unsigned char* plane = &s->planes[j * n];
+    if (mode == PLANE_RAW && bytes == n)
+      std::memcpy(plane, payload, n);
+    else if (mode == PLANE_CONSTANT && bytes == 1)
+      std::memset(plane, payload[0], n);
+    else if (mode == PLANE_RLE)
+      rle_decode(payload, bytes, plane, n);
+    else
+      corrupt();
+    offset += bytes;
+  }
+  unshuffle(&s->planes[0], n, &s->words[0]);
+  uint64_t previous = 0;
+  for (size_t i = 0; i < n; ++i) {
+    previous ^= s->words[i];
+    std::memcpy(x + i, &previous, sizeof(previous));
+  }
+}
+
+#if defined(__SSE2__)
+// One step of an 8x16 byte transpose held in r[0..7]: registers k and
+// k | bit are interleaved bytewise, the low halves to k. Four steps
+// shuffle 16 words into planes, three undo it.
+inline void interleave(__m128i* r, const int bit) {
+  __m128i t[8];
+  for (int k = 0; k < 8; ++k) {
+    if (k & bit)
+      continue;
+    t[k] = _mm_unpacklo_epi8(r[k], r[k | bit]);
+    t[k | bit] = _mm_unpackhi_epi8(r[k], r[k | bit]);
+  }
+  for (int k = 0; k < 8; ++k)
+    r[k] = t[k];
+}
+#endif
+
+}  // namespace
+
+void shuffle(const uint64_t* words, const size_t n, unsigned char* planes) {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(words);
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 16 <= n; i += 16) {
+    __m128i r[8];
+    for (int k = 0; k < 8; ++k)
+      r[k] = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(words + i + 2 * k));
+    interleave(r, 4);
+    interleave(r, 2);
+    interleave(r, 1);
+    interleave(r, 4);
+    // the steps leave plane j in register (j0 j2 j1), in binary
+    for (int j = 0; j < 8; ++j)
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(planes + j * n + i),
+                       r[((j & 1) << 2) | ((j & 4) >> 1) | ((j & 2) >> 1)]);
+  }
+#endif
+  for (; i < n; ++i)
+    for (size_t j = 0; j < PLANES; ++j)
+      planes[j * n + i] = bytes[i * PLANES + j];
+}
+
+void unshuffle(const unsigned char* planes, const size_t n, uint64_t* words) {
+  unsigned char* bytes = reinterpret_cast<unsigned char*>(words);
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 16 <= n; i += 16) {
+    __m128i r[8];
+    for (int j = 0; j < 8; ++j)
+      r[j] = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(planes + j * n + i));
+    interleave(r, 4);
+    interleave(r, 2);
+    interleave(r, 1);
+    for (int k = 0; k < 8; ++k)
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(words + i + 2 * k), r[k]);
+  }
+#endif
+  for (; i < n; ++i)
+    for (size_t j = 0; j < PLANES; ++j)
+      bytes[i * PLANES + j] = planes[j * n + i];
+}
+
+namespace {
+
+// Framing shared by the codecs: prefix words (always beginning with
+// the number of elements and the elements per block), the offsets of
+// the blocks and of the end, then the blocks, each coded by
+// code(x, n, scratch, out) into at most max_bytes
+template <class Code>
+void encode_blocks(const FastArrayView& v, std::vector<uint64_t> index,
+                   const size_t max_bytes, const Code& code,
+                   std::vector<char>* out) {
+  const size_t size = v.size();
+  const size_t per_block = index[1];
+  const size_t num_blocks = (size + per_block - 1) / per_block;
+  const size_t words = index.size();
+
+  // blocks are coded into slots of the largest size, then packed
+  const std::unique_ptr<char[]> slots(new char[num_blocks * max_bytes]);
+  std::vector<size_t> lengths(num_blocks);
+#if defined(_OPENMP)
+#pragma omp parallel
+#endif
+  {
+    scratch s(per_block);
+#if defined(_OPENMP)
+#pragma omp for schedule(dynamic)
+#endif
+    for (int64_t b = 0; b < static_cast<int64_t>(num_blocks); ++b) {
+      const size_t begin = b * per_block;
+      const size_t n = std::min(per_block, size - begin);
+      lengths[b] = code(v.data() + begin, n, &s, &slots[b * max_bytes]);
+    }
+  }
+
+  index.resize(words + num_blocks + 1);
+  index[words] = index.size() * sizeof(uint64_t);
+  for (size_t b = 0; b < num_blocks; ++b)
+    index[words + b + 1] = index[words + b] + lengths[b];
+  const size_t start = out->size();
+  out->resize(start + index.back());
+  std::memcpy(&(*out)[start], &index[0], index.size() * sizeof(uint64_t));
+  for (size_t b = 0; b < num_blocks; ++b)
+    std::memcpy(&(*out)[start + index[words + b]], &slots[b * max_bytes],
+                lengths[b]);
+}
+
+// Reads words prefix words into prefix, checks the framing, and
+// decodes the blocks with code(in, length, n, scratch, x)
+template <class Code>
+void decode_blocks(const char* data, const size_t bytes, uint64_t* prefix,
+                   const size_t words, const Code& code, ScalarT* out) {
+  if (bytes < words * sizeof(uint64_t))
+    corrupt();
+  std::memcpy(prefix, data, words * sizeof(uint64_t));
+  const uint64_t size = prefix[0];
+  const uint64_t per_block = prefix[1];
+  if (per_block == 0 || per_block > (1u << 24))
+    corrupt();
+  const uint64_t num_blocks = (size + per_block - 1) / per_block;
+  if (num_blocks + words + 1 > bytes / sizeof(uint64_t))
+    corrupt();
+  std::vector<uint64_t> index(num_blocks + 1);
+  std::memcpy(&index[0], data + words * sizeof(uint64_t),
+              index.size() * sizeof(uint64_t));
+  if (index[0] != (num_blocks + words + 1) * sizeof(uint64_t) ||
+      index[num_blocks] > bytes)
+    corrupt();
+  for (uint64_t b = 0; b < num_blocks; ++b)
+    if (index[b + 1] < index[b])
+      corrupt();
+
+  // exceptions must not leave a parallel region
+  bool failed = false;
+#if defined(_OPENMP)
+#pragma omp parallel
+#endif
+  {
+    scratch s(per_block);
+#if defined(_OPENMP)
+#pragma omp for schedule(dynamic)
+#endif
+    for (int64_t b = 0; b < static_cast<int64_t>(num_blocks); ++b) {
+      const uint64_t begin = b * per_block;
+      try {
+        code(data + index[b], index[b + 1] - index[b],
+             std::min(per_block, size - begin), &s, out + begin);
+      } catch (const io::io_error&) {
+#if defined(_OPENMP)
+#pragma omp atomic write
+#endif
+        failed = true;
+      }
+    }
+  }
+  if (failed)
+    corrupt();
+}
+
+struct lossless_encoder {
+  size_t operator()(const ScalarT* x, const size_t n, scratch* s,
+                    char* out) const {
+    return encode_block(x, n, s, out);
+  }
+};
+
+struct lossless_decoder {
+  void operator()(const char* in, const size_t length, const size_t n,
+                  scratch* s, ScalarT* x) const {
+    decode_block(in, length, n, s, x);
+  }
+};
+
+//
+// Error-bounded blocks. Each element is predicted by its decoded
+// predecessor (the 1-D Lorenzo predictor) and the difference is
+// quantized to a multiple q of twice the bound. q is zigzag coded and
+// packed in groups of GROUP, each group with the bit width of its
+// largest code. Elements whose reconstruction would miss the bound
+// (non-finite values, huge jumps, rounding at the edge of a bin) get
+// the ESCAPE code and are stored exactly after the packed codes:
+//
+//   width of each group, one byte
+//   packed codes, little-endian bit order
+//   escaped elements
+//
+const size_t GROUP = 64;
+const uint64_t ESCAPE = 1ull << 52;
+const unsigned MAX_WIDTH = 53;
+// |q| stays below this, so zigzag codes stay below ESCAPE
+const double MAX_STEPS = 1125899906842624.0;  // 2^50
+
+uint64_t zigzag(const int64_t q) {
+  return (static_cast<uint64_t>(q) << 1) ^ static_cast<uint64_t>(q >> 63);
+}
+
+int64_t unzigzag(const uint64_t z) {
+  return static_cast<int64_t>(z >> 1) ^ -static_cast<int64_t>(z & 1);
+}
+
+// Largest bounded encoding of n elements: every element escaped
+size_t max_bounded_bytes(const size_t n) {
+  return n / GROUP + 1 + (MAX_WIDTH * n + 7) / 8 + n * sizeof(ScalarT);
+}
+
+struct bit_writer {
+  explicit bit_writer(unsigned char* out) : p(out), acc(0), bits(0) {}
+  // width at most 56
+  void put(const uint64_t v, const unsigned width) {
+    acc |= v << bits;
+    bits += width;
+    for (; bits >= 8; bits -= 8) {
+      *p++ = static_cast<unsigned char>(acc);
+      acc >>= 8;
+    }
+  }
+  unsigned char* flush() {
+    if (bits > 0)
+      *p++ = static_cast<unsigned char>(acc);
+    return p;
+  }
+  unsigned char* p;
+  uint64_t acc;
+  unsigned bits;
+};
+
+struct bit_reader {
+  bit_reader(const unsigned char* begin, const unsigned char* end)
+    : p(begin), end(end), acc(0), bits(0) {}
+  uint64_t get(const unsigned width) {
+    for (; bits < width; bits += 8) {
+      if (p == end)
+        corrupt();
+      acc |= static_cast<uint64_t>(*p++) << bits;
+    }
+    const uint64_t v = acc & ((1ull << width) - 1);
+    acc >>= width;
+    bits -= width;
+    return v;
+  }
+  const unsigned char* p;
+  const unsigned char* end;
+  uint64_t acc;
+  unsigned bits;
+};
+
+struct bounded_encoder {
+  explicit bounded_encoder(const double error_bound)
+    : bound(error_bound),
+      step(2 * error_bound),
+      inverse_step(1 / step) {}
+
+  size_t operator()(const ScalarT* x, const size_t n, scratch* s,
+                    char* out) const {
+    uint64_t* codes = &s->words[0];
+    ScalarT previous = 0;
+    size_t num_escaped = 0;
+    for (size_t i = 0; i < n; ++i) {
+      const double diff = x[i] - previous;
+      uint64_t code = ESCAPE;
+      ScalarT value = x[i];
+      // false for NaN and infinities as well as for huge differences
+      if (std::fabs(diff) < MAX_STEPS * step) {
+        // any rounding of q is caught by the check of r
+        const double q = std::nearbyint(diff * inverse_step);
+        const ScalarT r = previous + step * q;
+        if (std::fabs(r - x[i]) < bound) {
+          code = zigzag(static_cast<int64_t>(q));
+          value = r;
+        }
+      }
+      if (code == ESCAPE)
+        s->escaped[num_escaped++] = x[i];
+      codes[i] = code;
+      previous = value;
+    }
+
+    unsigned char* widths = reinterpret_cast<unsigned char*>(out);
+    const size_t groups = (n + GROUP - 1) / GROUP;
+    bit_writer packed(widths + groups);
+    for (size_t g = 0; g < groups; ++g) {
+      const size_t end = std::min(n, (g + 1) * GROUP);
+      uint64_t any = 0;
+      for (size_t i = g * GROUP; i < end; ++i)
+        any |= codes[i];
+      const unsigned width = any == 0 ? 0 : 64 - __builtin_clzll(any);
+      widths[g] = static_cast<unsigned char>(width);
+      if (width > 0)
+        for (size_t i = g * GROUP; i < end; ++i)
+          packed.put(codes[i], width);
+    }
+    unsigned char* escaped = packed.flush();
+    std::memcpy(escaped, &s->escaped[0], num_escaped * sizeof(ScalarT));
+    return escaped + num_escaped * sizeof(ScalarT) - widths;
+  }
+
+  const double bound;
+  const double step;
+  const double inverse_step;
+};
+
+struct bounded_decoder {
+  explicit bounded_decoder(const double error_bound)
+    : step(2 * error_bound) {}
+
+  void operator()(const char* in, const size_t length, const size_t n,
+                  scratch* s, ScalarT* x) const {
+    const unsigned char* widths = reinterpret_cast<const unsigned char*>(in);
+    const unsigned char* end = widths + length;
+    const size_t groups = (n + GROUP - 1) / GROUP;
+    if (length < groups)
+      corrupt();
+    uint64_t* codes = &s->words[0];
+    bit_reader packed(widths + groups, end);
+    for (size_t g = 0; g < groups; ++g) {
+      const unsigned width = widths[g];
+      if (width > MAX_WIDTH)
+        corrupt();
+      const size_t last = std::min(n, (g + 1) * GROUP);
+      for (size_t i = g * GROUP; i < last; ++i)
+        codes[i] = width > 0 ? packed.get(width) : 0;
+    }
+
+    const unsigned char* escaped = packed.p;
+    ScalarT previous = 0;
+    for (size_t i = 0; i < n; ++i) {
+      if (codes[i] == ESCAPE) {
+        if (end - escaped < static_cast<ptrdiff_t>(sizeof(ScalarT)))
+          corrupt();
+        std::memcpy(&previous, escaped, sizeof(ScalarT));
+        escaped += sizeof(ScalarT);
+      } else if (codes[i] < ESCAPE) {
+        previous = previous + step * static_cast<double>(unzigzag(codes[i]));
+      } else {
+        corrupt();
+      }
+      x[i] = previous;
+    }
+    if (escaped != end)
+      corrupt();
+  }
+
+  const double step;
+};
+
+}  // namespace
+
+void encode(const FastArrayView& v, std::vector<char>* out) {
+  std::vector<uint64_t> prefix(2);
+  prefix[0] = v.size();
+  prefix[1] = BLOCK_ELEMENTS;
+  encode_blocks(v, prefix, max_block_bytes(BLOCK_ELEMENTS),
+                lossless_encoder(), out);
+}
+
+uint64_t decoded_size(const char* data, const size_t bytes) {
+  uint64_t size;
+  if (bytes < 2 * sizeof(uint64_t))
+    corrupt();
+  std::memcpy(&size, data, sizeof(size));
+  return size;
+}
+
+void decode(const char* data, const size_t bytes, ScalarT* out) {
+  uint64_t prefix[2];
+  decode_blocks(data, bytes, prefix, 2, lossless_decoder(), out);
+}
+
+void encode_bounded(const FastArrayView& v, const double error_bound,
+                    std::vector<char>* out) {
+  if (!(error_bound > 0) || !std::isfinite(2 * error_bound))
+    throw std::invalid_argument("encode_bounded: bad error bound");
+  std::vector<uint64_t> prefix(3);
+  prefix[0] = v.size();
+  prefix[1] = BLOCK_ELEMENTS;
+  std::memcpy(&prefix[2], &error_bound, sizeof(error_bound));
+  encode_blocks(v, prefix, max_bounded_bytes(BLOCK_ELEMENTS),
+                bounded_encoder(error_bound), out);
+}
+
+double error_bound(const char* data, const size_t bytes) {
+  double bound;
+  if (bytes < 3 * sizeof(uint64_t))
+    corrupt();
+  std::memcpy(&bound, data + 2 * sizeof(uint64_t), sizeof(bound));
+  return bound;
+}
+
+void decode_bounded(const char* data, const size_t bytes, ScalarT* out) {
+  const double bound = error_bound(data, bytes);
+  if (!(bound > 0) || !std::isfinite(2 * bound))
+    corrupt();
+  uint64_t prefix[3];
+  decode_blocks(data, bytes, prefix, 3, bounded_decoder(bound), out);
+}
+
+}  // namespace codec
+}  // namespace fa
@@ -0,0 +1,70 @@
+// Copyright 2011 Patrick K. Notz
+#ifndef SRC_FA_CODEC_HPP_
+#define SRC_FA_CODEC_HPP_
+
+#include <FastArray.hpp>
+#include <stdint.h>
+#include <vector>
+
+namespace fa {
+namespace codec {
+
+//
+// Lossless compression of float64 arrays, tuned for smooth fields.
+// Each element is XORed with its predecessor, which zeroes the sign,
+// exponent and leading mantissa bits that neighbors share; the words
+// are then byte-shuffled into eight planes (all first bytes, all
+// second bytes, ...) so those zeros line up, and each plane is
+// run-length coded (PackBits), stored as a constant, or stored raw,
+// whichever is smallest. Blocks of BLOCK_ELEMENTS are coded
+// independently, in parallel with OpenMP.
+//
+// Encoding, in native byte order:
+//
+//   uint64  number of elements
+//   uint64  elements per block
+//   uint64  offsets of the blocks and of the end, from the start
+//   blocks  per plane a mode byte and uint32 length, then the planes
+//
+// Corrupt input throws fa::io::io_error.
+//
+
+const IndexT BLOCK_ELEMENTS = 1 << 14;
+
+// Appends the encoding of v to out
+void encode(const FastArrayView& v, std::vector<char>* out);
+
+// Elements in an encoding of at least 16 bytes
+uint64_t decoded_size(const char* data, const size_t bytes);
+
+// Decodes bytes of data into out, which must hold decoded_size()
+// elements
+void decode(const char* data, const size_t bytes, ScalarT* out);
+
+//
+// Error-bounded lossy compression: every decoded element is within
+// error_bound of the original (strictly), and non-finite elements
+// decode exactly. Elements are predicted from their decoded
+// predecessor, the prediction error is quantized to a multiple of
+// 2 * error_bound, and the quantized values are bit-packed in groups
+// of 64 at the width of the largest; smooth fields quantized coarsely
+// relative to their variation pack to a few bits per element. Blocks
+// are coded in parallel as for encode(); the encoding uses the same
+// framing with the error bound as a third prefix word.
+//
+void encode_bounded(const FastArrayView& v, const double error_bound,
+                    std::vector<char>* out);
+
+// The error bound of a bounded encoding
+double error_bound(const char* data, const size_t bytes);
+
+void decode_bounded(const char* data, const size_t bytes, ScalarT* out);
+
+// Byte j of word i goes to planes[j * n + i], and back
+void shuffle(const uint64_t* words, const size_t n, unsigned char* planes);
+void unshuffle(const unsigned char* planes, const size_t n, uint64_t* words);
+
+}  // namespace codec
+}  // namespace fa
+
+#endif  // SRC_FA_CODEC_HPP_
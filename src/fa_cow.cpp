@@ -0,0 +1,71 @@
+// Copyright 2011 Patrick K. Notz
+#include <fa_cow.hpp>
+#include <atomic>
+#include <new>
+
+namespace fa {
+namespace cow {
+
+namespace {
+
+// Elements taken by the reference count, a cache line
+const IndexT HEADER = 64 / sizeof(ScalarT);
+
+typedef std::atomic<int64_t> Count;
+
+Count* count_of(const ScalarT* p) {
+  return reinterpret_cast<Count*>(const_cast<ScalarT*>(p) - HEADER);
+}
+
+}  // namespace
+
+Allocator::Allocator() : m_backing(heap_allocator()) {}
+
+Allocator::Allocator(fa::Allocator* backing) : m_backing(backing) {}
+
+ScalarT* Allocator::allocate(const IndexT n) {
+  static_assert(sizeof(Count) <= HEADER * sizeof(ScalarT),
+                "the reference count must fit the header");
+  ScalarT* base = m_backing->allocate(n + HEADER);
+  new (base) Count(1);
+  return base + HEADER;
+}
+
+void Allocator::deallocate(ScalarT* p, const IndexT n) {
+  release(p, n);
+}
+
+bool Allocator::counts_references() const {
+  return true;
+}
+
+void Allocator::add_reference(ScalarT* p) {
+  count_of(p)->fetch_add(1, std::memory_order_relaxed);
+}
+
+// Acquire pairs with the release in release(): an array that finds
+// itself the only holder may write where the others last read
+bool Allocator::is_shared(const ScalarT* p) const {
+  return count_of(p)->load(std::memory_order_acquire) > 1;
+}
+
+bool Allocator::release(ScalarT* p, const IndexT n) {
+  Count* count = count_of(p);
+  if (count->fetch_sub(1, std::memory_order_acq_rel) != 1)
+    return false;
+  count->~Count();
+  m_backing->deallocate(p - HEADER, n + HEADER);
+  return true;
+}
+
+int64_t Allocator::references(const ScalarT* p) const {
+  return count_of(p)->load(std::memory_order_acquire);
+}
+
+fa::Allocator* allocator() {
+  static Allocator allocator;
+  return &allocator;
+}
+
+}  // namespace cow
+}  // namespace fa
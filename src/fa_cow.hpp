@@ -0,0 +1,76 @@
+// Copyright 2011 Patrick K. Notz
+#ifndef SRC_FA_COW_HPP_
+#define SRC_FA_COW_HPP_
+
+#include <FastArray.hpp>
+#include <stdint.h>
+
+namespace fa {
+namespace cow {
+
+//
+// Copy-on-write arrays, for code that copies FastArrays by value,
+// e.g. into caches, mostly to read them. Arrays of a cow::Allocator
+// share their buffer with their copies, in O(1), and the first write
+// to a shared buffer through any of them -- non-const operator[] or
+// data(), an assignment, evaluate() or stream() -- first gives that
+// array a copy of its own. Copies of such arrays keep the allocator,
+// and assigning one to another of the same allocator shares too.
+//
+//   fa::FastArray u(n, fa::cow::allocator());
+//   fa::FastArray saved(u);   // shares u's buffer
+//   u = u + dt * du;          // u moves to a buffer of its own
+//
+// Reference counts are atomic, so arrays sharing a buffer may be
+// copied, written and destroyed from different threads; each array
+// itself is no more thread-safe than before, and fa::parallel()
+// unshares its destination before the threads start. Non-const
+// element access on a shared array counts as a write, so read
+// through a const reference to keep sharing.
+//
+// The buffer is unshared when a pointer or reference is taken, not
+// when it is written through, so one kept across a copy writes the
+// buffer the copy now shares:
+//
+//   double* p = u.data();
+//   fa::FastArray saved(u);   // shares u's buffer
+//   p[0] = 1;                 // changes saved too
+//
+// Take pointers and references from data() and operator[] again
+// after copying the array, as after resize().
+//
+// Each buffer carries a 64-byte reference count in front of its
+// elements, which keeps the alignment of the buffers of the backing
+// allocator that holds them.
+//
+class Allocator : public fa::Allocator {
+ public:
+  // Buffers from new[], or from backing (which must outlive this)
+  Allocator();
+  explicit Allocator(fa::Allocator* backing);
+
+  ScalarT* allocate(const IndexT n);
+  void deallocate(ScalarT* p, const IndexT n);
+
+  bool counts_references() const;
+  void add_reference(ScalarT* p);
+  bool is_shared(const ScalarT* p) const;
+  bool release(ScalarT* p, const IndexT n);
+
+  // References to p, for tests and diagnostics
+  int64_t references(const ScalarT* p) const;
+
+ private:
+  Allocator(const Allocator&);
+  Allocator& operator=(const Allocator&);
+
+  fa::Allocator* m_backing;
+};
+
+// A copy-on-write allocator backed by new[]
+fa::Allocator* allocator();
+
+}  // namespace cow
+}  // namespace fa
+
+#endif  // SRC_FA_COW_HPP_
@@ -0,0 +1,322 @@
+// Copyright 2011 Patrick K. Notz
+#include <fa_io.hpp>
+#include <fa_codec.hpp>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace fa {
+namespace io {
+
+namespace {
+
+const char MAGIC[8] = { 'F', 'A', 'S', 'T', 'A', 'R', 'R', '\0' };
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+const uint32_t VERSION = 1;
+const uint32_t VERSION_CODEC = 2;
+const uint32_t ALIGNMENT = 64;
+
+// Bytes per read() or write() call
+const size_t CHUNK_BYTES = 64 << 20;
+
+static_assert(sizeof(Header) == 64, "Header must be 64 bytes");
+
+Header make_header(const uint64_t size, const uint64_t checksum) {
+  Header h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.byte_order = BYTE_ORDER_MARK;
+  h.version = VERSION;
+  h.header_bytes = sizeof(Header);
+  h.scalar_type = SCALAR_FLOAT64;
+  h.scalar_bytes = sizeof(ScalarT);
+  h.alignment = ALIGNMENT;
+  h.size = size;
+  h.checksum = checksum;
+  return h;
+}
+
+}  // namespace
+
+// Messages are built with append(): inside namespace fa, fa's
+// operator+ templates would be candidates for string concatenation
+io_error::io_error(const char* what, const std::string& path)
+  : std::runtime_error(std::string(what).append(path)) {}
+
+io_error io_error::from_errno(const char* what, const std::string& path) {
+  return io_error(std::string(what).append(path).append(": ")
+                  .append(std::strerror(errno)));
+}
+
+File::File(const std::string& path, const int flags)
+  : m_path(path),
+    m_fd(::open(path.c_str(), flags, 0644)) {
+  if (m_fd < 0)
+    throw io_error::from_errno("cannot open ", path);
+}
+
+File::~File() {
+  if (m_fd >= 0)
+    ::close(m_fd);
+}
+
+uint64_t File::size() const {
+  struct stat st;
+  if (::fstat(m_fd, &st) != 0)
+    throw io_error::from_errno("cannot stat ", m_path);
+  return st.st_size;
+}
+
+void File::read_at(void* data, size_t bytes, uint64_t offset) const {
+  char* p = static_cast<char*>(data);
+  while (bytes > 0) {
+    const ssize_t n = ::pread(m_fd, p, std::min(bytes, CHUNK_BYTES), offset);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      throw io_error::from_errno("cannot read ", m_path);
+    if (n == 0)
+      throw io_error("unexpected end of file ", m_path);
+    p += n;
+    bytes -= n;
+    offset += n;
+  }
+}
+
+void File::write_at(const void* data, size_t bytes, uint64_t offset) {
+  const char* p = static_cast<const char*>(data);
+  while (bytes > 0) {
+    const ssize_t n = ::pwrite(m_fd, p, std::min(bytes, CHUNK_BYTES),
+                               offset);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      throw io_error::from_errno("cannot write ", m_path);
+    p += n;
+    bytes -= n;
+    offset += n;
+  }
+}
+
+void File::close() {
+  const int fd = m_fd;
+  m_fd = -1;
+  if (::close(fd) != 0)
+    throw io_error::from_errno("cannot close ", m_path);
+}
+
+Mapping::Mapping(const File& file, const size_t length)
+  : m_base(0),
+    m_length(length) {
+  // mmap() rejects empty mappings
+  if (m_length == 0)
+    return;
+  m_base = ::mmap(0, m_length, PROT_READ, MAP_SHARED, file.fd(), 0);
+  if (m_base == MAP_FAILED)
+    throw io_error::from_errno("cannot map ", file.path());
+}
+
+Mapping::~Mapping() {
+  if (m_length > 0)
+    ::munmap(m_base, m_length);
+}
+
+void Checksum::update(const void* data, const size_t bytes) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  uint64_t a = m_a, b = m_b;
+  for (size_t k = 0; k + sizeof(uint64_t) <= bytes; k += sizeof(uint64_t)) {
+    uint64_t w;
+    std::memcpy(&w, p + k, sizeof(w));
+    a += w;
+    b += a;
+  }
+  m_a = a;
+  m_b = b;
+}
+
+uint64_t Checksum::value() const {
+  return m_b ^ (m_a * 0x9E3779B97F4A7C15ull);
+}
+
+void save(const std::string& path, const FastArrayView& v) {
+  Writer writer(path);
+  writer.write(v);
+  writer.close();
+}
+
+void save(const std::string& path, const FastArrayView& v,
+          const Codec codec) {
+  save(path, v, codec, 0);
+}
+
+void save(const std::string& path, const FastArrayView& v,
+          const Codec codec, const double error_bound) {
+  if (codec == CODEC_NONE) {
+    save(path, v);
+    return;
+  }
+  std::vector<char> encoded;
+  Checksum checksum;
+  switch (codec) {
+    case CODEC_LOSSLESS:
+      codec::encode(v, &encoded);
+      checksum.update(v.data(), v.size() * sizeof(ScalarT));
+      break;
+    case CODEC_BOUNDED: {
+      if (!(error_bound > 0))
+        throw io_error("CODEC_BOUNDED needs a positive error bound for ",
+                       path);
+      codec::encode_bounded(v, error_bound, &encoded);
+      // the checksum is of what will be loaded
+      FastArray decoded(v.size());
+      codec::decode_bounded(&encoded[0], encoded.size(), decoded.data());
+      checksum.update(decoded.data(), v.size() * sizeof(ScalarT));
+      break;
+    }
+    default:
+      throw io_error("unknown codec for ", path);
+  }
+  Header h = make_header(v.size(), checksum.value());
+  h.version = VERSION_CODEC;
+  h.codec = codec;
+  h.encoded_bytes = encoded.size();
+  // as with Writer, the header goes last and a file that could not be
+  // completed is removed, so a failed save leaves nothing that loads
+  File file(path, O_WRONLY | O_CREAT | O_TRUNC);
+  try {
+    if (!encoded.empty())
+      file.write_at(&encoded[0], encoded.size(), h.header_bytes);
+    file.write_at(&h, sizeof(h), 0);
+    file.close();
+  } catch (const io_error&) {
+    ::unlink(path.c_str());
+    throw;
+  }
+}
+
+Writer::Writer(const std::string& path)
+  : m_file(path, O_WRONLY | O_CREAT | O_TRUNC),
+    m_size(0),
+    m_closed(false) {}
+
+// A writer that was not closed, e.g. one unwound by an exception,
+// holds an incomplete array: it is removed rather than finalized, so
+// no truncated file can pass for a good one
+Writer::~Writer() {
+  if (!m_closed)
+    ::unlink(m_file.path().c_str());
+}
+
+// Data goes out first, checksummed piece by piece while it is in
+// cache; the completed header is written last
+void Writer::write(const FastArrayView& chunk) {
+  const char* data = reinterpret_cast<const char*>(chunk.data());
+  const size_t bytes = static_cast<size_t>(chunk.size()) * sizeof(ScalarT);
+  const uint64_t start = sizeof(Header) + m_size * sizeof(ScalarT);
+  for (size_t offset = 0; offset < bytes; offset += CHUNK_BYTES) {
+    const size_t n = std::min(CHUNK_BYTES, bytes - offset);
+    m_checksum.update(data + offset, n);
+    m_file.write_at(data + offset, n, start + offset);
+  }
+  m_size += chunk.size();
+}
+
+void Writer::close() {
+  const Header h = make_header(m_size, m_checksum.value());
+  m_file.write_at(&h, sizeof(h), 0);
+  m_file.close();
+  m_closed = true;
+}
+
+Header read_header(const File& file) {
+  const std::string& path = file.path();
+  Header h;
+  file.read_at(&h, sizeof(h), 0);
+  if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0)
+    throw io_error("not a FastArray file: ", path);
+  if (h.byte_order != BYTE_ORDER_MARK)
+    throw io_error("byte order mismatch: ", path);
+  if (h.version != VERSION && h.version != VERSION_CODEC)
+    throw io_error("unsupported format version: ", path);
+  if (h.version == VERSION ? h.codec != CODEC_NONE || h.encoded_bytes != 0
+                           : h.codec != CODEC_LOSSLESS &&
+                                 h.codec != CODEC_BOUNDED)
+    throw io_error("unsupported codec: ", path);
+  if (h.scalar_type != SCALAR_FLOAT64 || h.scalar_bytes != sizeof(ScalarT))
+    throw io_error("scalar type mismatch: ", path);
+  if (h.alignment == 0 || h.header_bytes < sizeof(Header) ||
+      h.header_bytes % h.alignment != 0)
+    throw io_error("corrupt header: ", path);
+  if (h.size > static_cast<uint64_t>(std::numeric_limits<IndexT>::max()))
+    throw io_error("too many elements for IndexT: ", path);
+  const uint64_t data_bytes = h.codec == CODEC_NONE
+      ? h.size * sizeof(ScalarT) : h.encoded_bytes;
+  if (file.size() < h.header_bytes + data_bytes)
+    throw io_error("truncated file: ", path);
+  return h;
+}
+
+Header read_header(const std::string& path) {
+  const File file(path, O_RDONLY);
+  return read_header(file);
+}
+
+void load(const std::string& path, FastArray* out) {
+  const File file(path, O_RDONLY);
+  const Header h = read_header(file);
+  out->resize(static_cast<IndexT>(h.size));
+  if (h.codec == CODEC_NONE) {
+    file.read_at(out->data(), h.size * sizeof(ScalarT), h.header_bytes);
+  } else {
+    std::vector<char> encoded(h.encoded_bytes);
+    if (!encoded.empty())
+      file.read_at(&encoded[0], encoded.size(), h.header_bytes);
+    if (encoded.size() < 2 * sizeof(uint64_t) ||
+        codec::decoded_size(&encoded[0], encoded.size()) != h.size)
+      throw io_error("corrupt compressed data: ", path);
+    if (h.codec == CODEC_BOUNDED)
+      codec::decode_bounded(&encoded[0], encoded.size(), out->data());
+    else
+      codec::decode(&encoded[0], encoded.size(), out->data());
+  }
+  Checksum checksum;
+  checksum.update(out->data(), h.size * sizeof(ScalarT));
+  if (checksum.value() != h.checksum)
+    throw io_error("checksum mismatch: ", path);
+}
+
+MappedArray::MappedArray(const std::string& path)
+  : MappedArray(File(path, O_RDONLY)) {}
+
+namespace {
+
+Header read_unencoded_header(const File& file) {
+  const Header h = read_header(file);
+  if (h.codec != CODEC_NONE)
+    throw io_error("cannot map an encoded file: ", file.path());
+  return h;
+}
+
+}  // namespace
+
+MappedArray::MappedArray(const File& file)
+  : m_header(read_unencoded_header(file)),
+    m_mapping(file, m_header.header_bytes + m_header.size * sizeof(ScalarT)),
+    m_view(reinterpret_cast<const ScalarT*>(m_mapping.data() +
+                                            m_header.header_bytes),
+           static_cast<IndexT>(m_header.size)) {}
+
+bool MappedArray::verify() const {
+  Checksum checksum;
+  checksum.update(m_view.data(), m_view.size() * sizeof(ScalarT));
+  return checksum.value() == m_header.checksum;
+}
+
+}  // namespace io
+}  // namespace fa
@@ -0,0 +1,233 @@
+// Copyright 2011 Patrick K. Notz
+#ifndef SRC_FA_IO_HPP_
+#define SRC_FA_IO_HPP_
+
+#include <FastArray.hpp>
+#include <stdint.h>
+#include <stdexcept>
+#include <string>
+
+namespace fa {
+namespace io {
+
+//
+// Binary array files -- a 64-byte header followed by the elements in
+// native layout, starting on a 64-byte boundary so that a mapped file
+// is as aligned as an allocated array:
+//
+//   offset  field
+//        0  magic "FASTARR\0"
+//        8  byte order mark 0x01020304, as written
+//       12  format version
+//       16  header bytes, i.e. the offset of the data
+//       20  scalar type (SCALAR_FLOAT64)
+//       24  scalar bytes
+//       28  data alignment
+//       32  number of elements
+//       40  checksum of the data, see Checksum
+//       48  codec of the data (version 2)
+//       52  reserved, zero
+//       56  bytes of encoded data (version 2)
+//
+// Version 1 files hold the elements themselves. Version 2 files may
+// instead hold them encoded by a codec (fa_codec.hpp), in which case
+// the checksum is that of the decoded elements -- for a lossy codec,
+// of what load() returns.
+//
+struct Header {
+  char magic[8];
+  uint32_t byte_order;
+  uint32_t version;
+  uint32_t header_bytes;
+  uint32_t scalar_type;
+  uint32_t scalar_bytes;
+  uint32_t alignment;
+  uint64_t size;
+  uint64_t checksum;
+  uint32_t codec;
+  uint32_t reserved;
+  uint64_t encoded_bytes;
+};
+
+enum {
+  SCALAR_FLOAT64 = 1
+};
+
+enum Codec {
+  CODEC_NONE = 0,
+  CODEC_LOSSLESS = 1,  // codec::encode
+  CODEC_BOUNDED = 2    // codec::encode_bounded, lossy
+};
+
+// Thrown for any failed or invalid read or write
+class io_error : public std::runtime_error {
+ public:
+  explicit io_error(const std::string& what) : std::runtime_error(what) {}
+  // "<what><path>"
+  io_error(const char* what, const std::string& path);
+  // "<what><path>: <strerror(errno)>"
+  static io_error from_errno(const char* what, const std::string& path);
+};
+
+//
+// File - a POSIX file descriptor, closed on destruction, whose reads
+// and writes either complete or throw. Transfers are split into large
+// sequential calls.
+//
+class File {
+ public:
+  // flags as for open(2); files are created with mode 0644
+  File(const std::string& path, const int flags);
+  ~File();
+
+  int fd() const {
+    return m_fd;
+  }
+
+  const std::string& path() const {
+    return m_path;
+  }
+
+  uint64_t size() const;
+  void read_at(void* data, size_t bytes, uint64_t offset) const;
+  void write_at(const void* data, size_t bytes, uint64_t offset);
+
+  // Closes now, reporting errors of delayed writes
+  void close();
+
+ private:
+  File(const File&);
+  File& operator=(const File&);
+
+  const std::string m_path;
+  int m_fd;
+};
+
+//
+// Mapping - the first length bytes of a file mapped read-only
+//
+class Mapping {
+ public:
+  Mapping(const File& file, const size_t length);
+  ~Mapping();
+
+  const char* data() const {
+    return static_cast<const char*>(m_base);
+  }
+
+  size_t size() const {
+    return m_length;
+  }
+
+ private:
+  Mapping(const Mapping&);
+  Mapping& operator=(const Mapping&);
+
+  void* m_base;
+  size_t m_length;
+};
+
+//
+// Checksum - Fletcher-style sum over 64-bit words; cheap enough to
+// run at memory bandwidth, and sensitive to word order. Data may be
+// added in pieces of whole words.
+//
+class Checksum {
+ public:
+  Checksum() : m_a(0), m_b(0) {}
+  void update(const void* data, const size_t bytes);
+  uint64_t value() const;
+ private:
+  uint64_t m_a;
+  uint64_t m_b;
+};
+
+// Writes v to path with large sequential writes
+void save(const std::string& path, const FastArrayView& v);
+
+// Writes v to path encoded with codec
+void save(const std::string& path, const FastArrayView& v,
+          const Codec codec);
+
+// Writes v to path encoded with codec; error_bound is used by
+// CODEC_BOUNDED, which requires it to be positive
+void save(const std::string& path, const FastArrayView& v,
+          const Codec codec, const double error_bound);
+
+//
+// Writer - writes a file from consecutive chunks, so arrays larger
+// than memory can be produced piece by piece; the header, with the
+// size and checksum, is written by close(), and only then is the
+// file valid
+//
+class Writer {
+ public:
+  explicit Writer(const std::string& path);
+  // removes the file if close() did not complete
+  ~Writer();
+
+  void write(const FastArrayView& chunk);
+  void close();
+
+  uint64_t size() const {
+    return m_size;
+  }
+
+ private:
+  Writer(const Writer&);
+  Writer& operator=(const Writer&);
+
+  File m_file;
+  Checksum m_checksum;
+  uint64_t m_size;
+  bool m_closed;
+};
+
+// Reads and validates the header of path
+Header read_header(const std::string& path);
+Header read_header(const File& file);
+
+// Reads path into out, resizing it and decoding it if need be, and
+// verifies the checksum
+void load(const std::string& path, FastArray* out);
+
+//
+// MappedArray - a file mapped read-only into memory. Pages are read
+// on first access, so opening is cheap and data that is never touched
+// is never read. The checksum is only verified on request, since that
+// reads every page. Encoded files cannot be mapped.
+//
+class MappedArray {
+ public:
+  explicit MappedArray(const std::string& path);
+  // maps an open file; the file may be closed afterwards
+  explicit MappedArray(const File& file);
+
+  const FastArrayView& view() const {
+    return m_view;
+  }
+
+  IndexT size() const {
+    return m_view.size();
+  }
+
+  const ScalarT& operator[](const IndexT i) const {
+    return m_view[i];
+  }
+
+  // True if the data matches the header's checksum
+  bool verify() const;
+
+ private:
+  MappedArray(const MappedArray&);
+  MappedArray& operator=(const MappedArray&);
+
+  const Header m_header;
+  const Mapping m_mapping;
+  const FastArrayView m_view;
+};
+
+}  // namespace io
+}  // namespace fa
+
+#endif  // SRC_FA_IO_HPP_
@@ -0,0 +1,596 @@
+// Copyright 2011 Patrick K. Notz
+#include <fa_npy.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+namespace fa {
+
+namespace {
+
+using io::io_error;
+
+// Header bytes of the files written here: a multiple of 64 with room
+// for a shape of any uint64_t length
+const size_t HEADER_BYTES = 128;
+
+// Bytes per checksummed piece of an .npz member
+const size_t CHUNK_BYTES = 64 << 20;
+
+bool little_endian_host() {
+  const uint16_t one = 1;
+  return *reinterpret_cast<const unsigned char*>(&one) == 1;
+}
+
+//
+// Little-endian fields of .npy and zip headers
+//
+uint64_t get_le(const char* p, const int bytes) {
+  uint64_t v = 0;
+  for (int k = bytes - 1; k >= 0; --k)
+    v = (v << 8) | static_cast<unsigned char>(p[k]);
+  return v;
+}
+
+void put_le(std::string* out, uint64_t v, const int bytes) {
+  for (int k = 0; k < bytes; ++k, v >>= 8)
+    out->push_back(static_cast<char>(v & 0xff));
+}
+
+// True if [offset, offset + length) lies within an image of size bytes;
+// written so that offsets and lengths read from a corrupt file cannot
+// overflow
+bool within(const uint64_t offset, const uint64_t length,
+            const uint64_t size) {
+  return offset <= size && length <= size - offset;
+}
+
+//
+// Parsing of the header dictionary, e.g.
+// {'descr': '<f8', 'fortran_order': False, 'shape': (3, 4), }
+//
+size_t find_value(const std::string& dict, const char* key) {
+  const std::string quoted = std::string("'").append(key).append("'");
+  size_t p = dict.find(quoted);
+  if (p == std::string::npos)
+    return p;
+  p = dict.find(':', p + quoted.size());
+  if (p == std::string::npos)
+    return p;
+  return dict.find_first_not_of(" \t", p + 1);
+}
+
+struct Dtype {
+  char order;  // '<', '>', '|' or '='
+  char kind;   // 'f', 'i', 'u' or 'b'
+  int bytes;
+};
+
+Dtype parse_dtype(const std::string& descr) {
+  Dtype d = { '=', 0, 0 };
+  if (descr.size() >= 3 && std::strchr("<>|=", descr[0]) &&
+      std::strchr("fiub", descr[1])) {
+    d.order = descr[0];
+    d.kind = descr[1];
+    d.bytes = std::atoi(descr.c_str() + 2);
+  }
+  const bool supported = d.kind == 'f' ? d.bytes == 4 || d.bytes == 8
+                                       : d.bytes == 1 || d.bytes == 2 ||
+                                         d.bytes == 4 || d.bytes == 8;
+  if (!supported)
+    throw io_error("unsupported dtype ", descr);
+  return d;
+}
+
+bool swapped(const Dtype& d) {
+  if (d.order == '<')
+    return !little_endian_host();
+  if (d.order == '>')
+    return little_endian_host();
+  return false;
+}
+
+template <class T>
+void convert_as(const char* data, const uint64_t n, const bool swap,
+                ScalarT* out) {
+  for (uint64_t i = 0; i < n; ++i) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, data + i * sizeof(T), sizeof(T));
+    if (swap)
+      std::reverse(bytes, bytes + sizeof(T));
+    T v;
+    std::memcpy(&v, bytes, sizeof(T));
+    out[i] = static_cast<ScalarT>(v);
+  }
+}
+
+std::string header_dict(const uint64_t size) {
+  char shape[32];
+  std::snprintf(shape, sizeof(shape), "%llu",
+                static_cast<unsigned long long>(size));  // NOLINT
+  std::string dict(little_endian_host() ? "{'descr': '<f8', "
+                                        : "{'descr': '>f8', ");
+  dict.append("'fortran_order': False, 'shape': (").append(shape)
+      .append(",), }");
+  // pad with spaces to HEADER_BYTES, ending in a newline
+  dict.resize(HEADER_BYTES - 10 - 1, ' ');
+  return dict.append("\n");
+}
+
+std::string npy_header(const uint64_t size) {
+  std::string header("\x93NUMPY\x01\x00", 8);
+  put_le(&header, HEADER_BYTES - 10, 2);
+  return header.append(header_dict(size));
+}
+
+// Table-driven CRC-32 (IEEE 802.3), as zip requires
+struct CrcTable {
+  CrcTable() {
+    for (uint32_t n = 0; n < 256; ++n) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k)
+        c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      entries[n] = c;
+    }
+  }
+  uint32_t entries[256];
+};
+
+uint32_t crc32(uint32_t crc, const char* data, size_t bytes) {
+  static const CrcTable table;
+  crc = ~crc;
+  for (size_t k = 0; k < bytes; ++k)
+    crc = table.entries[(crc ^ static_cast<unsigned char>(data[k])) & 0xff] ^
+          (crc >> 8);
+  return ~crc;
+}
+
+IndexT checked_size(const npy::Info& info, const std::string& path) {
+  if (info.size > static_cast<uint64_t>(std::numeric_limits<IndexT>::max()))
+    throw io_error("too many elements for IndexT: ", path);
+  return static_cast<IndexT>(info.size);
+}
+
+FastArrayView native_view(const npy::Info& info, const char* image,
+                          const std::string& path) {
+  const char* data = image + info.data_offset;
+  if (!npy::is_native(info))
+    throw io_error("dtype needs conversion, cannot view: ", path);
+  if (reinterpret_cast<uintptr_t>(data) % sizeof(ScalarT) != 0)
+    throw io_error("data not aligned for a view: ", path);
+  return FastArrayView(reinterpret_cast<const ScalarT*>(data),
+                       checked_size(info, path));
+}
+
+}  // namespace
+
+namespace npy {
+
+Info parse_header(const char* data, const size_t available) {
+  if (available < 10 || std::memcmp(data, "\x93NUMPY", 6) != 0)
+    throw io_error("not an .npy image", "");
+  const int major = static_cast<unsigned char>(data[6]);
+  if (major < 1 || major > 3)
+    throw io_error("unsupported .npy version", "");
+  const size_t prefix = major == 1 ? 10 : 12;
+  if (available < prefix)
+    throw io_error("truncated .npy header", "");
+  const size_t length = get_le(data + 8, major == 1 ? 2 : 4);
+  if (available < prefix + length)
+    throw io_error("truncated .npy header", "");
+  const std::string dict(data + prefix, length);
+
+  Info info;
+  size_t p = find_value(dict, "descr");
+  if (p == std::string::npos || (dict[p] != '\'' && dict[p] != '"'))
+    throw io_error("unsupported dtype ", dict);
+  const size_t end = dict.find(dict[p], p + 1);
+  if (end == std::string::npos)
+    throw io_error("malformed .npy header ", dict);
+  info.descr = dict.substr(p + 1, end - p - 1);
+  const Dtype dtype = parse_dtype(info.descr);
+
+  p = find_value(dict, "fortran_order");
+  if (p == std::string::npos)
+    throw io_error("malformed .npy header ", dict);
+  info.fortran_order = dict.compare(p, 4, "True") == 0;
+
+  p = find_value(dict, "shape");
+  if (p == std::string::npos || dict[p] != '(')
+    throw io_error("malformed .npy header ", dict);
+  info.size = 1;
+  for (++p; p < dict.size() && dict[p] != ')'; ) {
+    if (dict[p] >= '0' && dict[p] <= '9') {
+      char* stop = 0;
+      const uint64_t extent = std::strtoull(dict.c_str() + p, &stop, 10);
+      if (extent != 0 &&
+          info.size > std::numeric_limits<uint64_t>::max() / extent)
+        throw io_error("malformed .npy shape ", dict);
+      info.shape.push_back(extent);
+      info.size *= extent;
+      p = stop - dict.c_str();
+    } else {
+      ++p;  // separators, spaces and Python 2 'L' suffixes
+    }
+  }
+
+  info.data_offset = prefix + length;
+  if (available < info.data_offset ||
+      (available - info.data_offset) / dtype.bytes < info.size)
+    throw io_error("truncated .npy data", "");
+  return info;
+}
+
+bool is_native(const Info& info) {
+  const Dtype d = parse_dtype(info.descr);
+  return d.kind == 'f' && d.bytes == sizeof(ScalarT) && !swapped(d);
+}
+
+void convert(const Info& info, const char* data, ScalarT* out) {
+  const Dtype d = parse_dtype(info.descr);
+  const bool swap = swapped(d);
+  if (is_native(info)) {
+    std::memcpy(out, data, info.size * sizeof(ScalarT));
+  } else if (d.kind == 'f') {
+    if (d.bytes == 4)
+      convert_as<float>(data, info.size, swap, out);
+    else
+      convert_as<double>(data, info.size, swap, out);
+  } else if (d.kind == 'i') {
+    switch (d.bytes) {
+      case 1: convert_as<int8_t>(data, info.size, swap, out); break;
+      case 2: convert_as<int16_t>(data, info.size, swap, out); break;
+      case 4: convert_as<int32_t>(data, info.size, swap, out); break;
+      default: convert_as<int64_t>(data, info.size, swap, out); break;
+    }
+  } else {
+    switch (d.bytes) {
+      case 1: convert_as<uint8_t>(data, info.size, swap, out); break;
+      case 2: convert_as<uint16_t>(data, info.size, swap, out); break;
+      case 4: convert_as<uint32_t>(data, info.size, swap, out); break;
+      default: convert_as<uint64_t>(data, info.size, swap, out); break;
+    }
+  }
+}
+
+Info read_info(const std::string& path) {
+  const io::File file(path, O_RDONLY);
+  const io::Mapping mapping(file, file.size());
+  return parse_header(mapping.data(), mapping.size());
+}
+
+void save(const std::string& path, const FastArrayView& v) {
+  Writer writer(path);
+  writer.write(v);
+  writer.close();
+}
+
+void load(const std::string& path, FastArray* out) {
+  const io::File file(path, O_RDONLY);
+  const io::Mapping mapping(file, file.size());
+  const Info info = parse_header(mapping.data(), mapping.size());
+  out->resize(checked_size(info, path));
+  convert(info, mapping.data() + info.data_offset, out->data());
+}
+
+MappedArray::MappedArray(const std::string& path)
+  : MappedArray(io::File(path, O_RDONLY)) {}
+
+MappedArray::MappedArray(const io::File& file)
+  : m_mapping(file, file.size()),
+    m_info(parse_header(m_mapping.data(), m_mapping.size())),
+    m_view(native_view(m_info, m_mapping.data(), file.path())) {}
+
+Writer::Writer(const std::string& path)
+  : m_file(path, O_WRONLY | O_CREAT | O_TRUNC),
+    m_size(0),
+    m_closed(false) {}
+
+Writer::~Writer() {
+  if (!m_closed)
+    ::unlink(m_file.path().c_str());
+}
+
+void Writer::write(const FastArrayView& chunk) {
+  m_file.write_at(chunk.data(), chunk.size() * sizeof(ScalarT),
+                  HEADER_BYTES + m_size * sizeof(ScalarT));
+  m_size += chunk.size();
+}
+
+void Writer::close() {
+  const std::string header = npy_header(m_size);
+  m_file.write_at(header.data(), header.size(), 0);
+  m_file.close();
+  m_closed = true;
+}
+
+}  // namespace npy
+
+namespace npz {
+
+namespace {
+
+const uint32_t LOCAL_HEADER = 0x04034b50;
+const uint32_t CENTRAL_HEADER = 0x02014b50;
+const uint32_t END_OF_DIRECTORY = 0x06054b50;
+const uint32_t ZIP64_END_OF_DIRECTORY = 0x06064b50;
+const uint32_t ZIP64_LOCATOR = 0x07064b50;
+const uint16_t ZIP64_EXTRA = 0x0001;
+// extra field used to pad member data to a 64-byte boundary
+const uint16_t PADDING_EXTRA = 0x4146;
+const uint64_t MAX_32 = 0xffffffffu;
+const uint64_t MAX_16 = 0xffffu;
+const uint16_t DOS_DATE_1980 = 0x21;
+
+const std::string NPY_SUFFIX(".npy");
+
+}  // namespace
+
+Archive::Archive(const std::string& path)
+  : Archive(io::File(path, O_RDONLY)) {}
+
+Archive::Archive(const io::File& file)
+  : m_path(file.path()),
+    m_mapping(file, file.size()) {
+  const char* data = m_mapping.data();
+  const uint64_t size = m_mapping.size();
+
+  // the end of central directory record is followed by a comment of
+  // at most 64 KiB
+  if (size < 22)
+    throw io_error("not a zip archive: ", m_path);
+  uint64_t eocd = size - 22;
+  const uint64_t stop = size > 22 + MAX_16 ? size - 22 - MAX_16 : 0;
+  while (get_le(data + eocd, 4) != END_OF_DIRECTORY) {
+    if (eocd == stop)
+      throw io_error("not a zip archive: ", m_path);
+    --eocd;
+  }
+  uint64_t entries = get_le(data + eocd + 10, 2);
+  uint64_t directory = get_le(data + eocd + 16, 4);
+  if ((entries == MAX_16 || directory == MAX_32) && eocd >= 20 &&
+      get_le(data + eocd - 20, 4) == ZIP64_LOCATOR) {
+    const uint64_t record = get_le(data + eocd - 20 + 8, 8);
+    if (!within(record, 56, size) ||
+        get_le(data + record, 4) != ZIP64_END_OF_DIRECTORY)
+      throw io_error("corrupt zip64 directory: ", m_path);
+    entries = get_le(data + record + 32, 8);
+    directory = get_le(data + record + 48, 8);
+  }
+
+  uint64_t p = directory;
+  for (uint64_t k = 0; k < entries; ++k) {
+    if (!within(p, 46, size) || get_le(data + p, 4) != CENTRAL_HEADER)
+      throw io_error("corrupt zip directory: ", m_path);
+    const uint64_t method = get_le(data + p + 10, 2);
+    uint64_t member_size = get_le(data + p + 24, 4);
+    uint64_t compressed_size = get_le(data + p + 20, 4);
+    const uint64_t name_length = get_le(data + p + 28, 2);
+    const uint64_t extra_length = get_le(data + p + 30, 2);
+    const uint64_t comment_length = get_le(data + p + 32, 2);
+    uint64_t local = get_le(data + p + 42, 4);
+    if (!within(p + 46, name_length + extra_length + comment_length, size))
+      throw io_error("corrupt zip directory: ", m_path);
+    std::string name(data + p + 46, name_length);
+
+    // ZIP64 values, present only for fields saturated above
+    const char* extra = data + p + 46 + name_length;
+    for (uint64_t e = 0; e + 4 <= extra_length; ) {
+      const uint64_t id = get_le(extra + e, 2);
+      const uint64_t length = get_le(extra + e + 2, 2);
+      if (e + 4 + length > extra_length)
+        throw io_error("corrupt zip extra field: ", m_path);
+      if (id == ZIP64_EXTRA) {
+        const char* v = extra + e + 4;
+        const char* const v_end = v + length;
+        if (member_size == MAX_32 && v + 8 <= v_end) {
+          member_size = get_le(v, 8);
+          v += 8;
+        }
+        if (compressed_size == MAX_32 && v + 8 <= v_end) {
+          compressed_size = get_le(v, 8);
+          v += 8;
+        }
+        if (local == MAX_32 && v + 8 <= v_end)
+          local = get_le(v, 8);
+      }
+      e += 4 + length;
+    }
+    p += 46 + name_length + extra_length + comment_length;
+
+    if (!within(local, 30, size) || get_le(data + local, 4) != LOCAL_HEADER)
+      throw io_error("corrupt zip member: ", m_path);
+    Member m;
+    m.offset = local + 30 + get_le(data + local + 26, 2) +
+               get_le(data + local + 28, 2);
+    m.size = member_size;
+    m.stored = method == 0 && compressed_size == member_size;
+    if (!within(m.offset, m.stored ? m.size : 0, size))
+      throw io_error("truncated zip member: ", m_path);
+    if (name.size() > NPY_SUFFIX.size() &&
+        name.compare(name.size() - NPY_SUFFIX.size(), NPY_SUFFIX.size(),
+                     NPY_SUFFIX) == 0)
+      name.resize(name.size() - NPY_SUFFIX.size());
+    m_members[name] = m;
+  }
+}
+
+std::vector<std::string> Archive::names() const {
+  std::vector<std::string> result;
+  for (std::map<std::string, Member>::const_iterator it = m_members.begin();
+       it != m_members.end(); ++it)
+    result.push_back(it->first);
+  return result;
+}
+
+bool Archive::contains(const std::string& name) const {
+  return m_members.count(name) > 0;
+}
+
+const Archive::Member& Archive::member(const std::string& name) const {
+  std::map<std::string, Member>::const_iterator it = m_members.find(name);
+  if (it == m_members.end())
+    throw io_error("no such member: ", name);
+  if (!it->second.stored)
+    throw io_error("compressed members are not supported: ", name);
+  return it->second;
+}
+
+npy::Info Archive::info(const std::string& name) const {
+  const Member& m = member(name);
+  return npy::parse_header(m_mapping.data() + m.offset, m.size);
+}
+
+FastArrayView Archive::view(const std::string& name) const {
+  return native_view(info(name), m_mapping.data() + member(name).offset,
+                     name);
+}
+
+void Archive::load(const std::string& name, FastArray* out) const {
+  const npy::Info i = info(name);
+  out->resize(checked_size(i, name));
+  npy::convert(i, m_mapping.data() + member(name).offset + i.data_offset,
+               out->data());
+}
+
+Writer::Writer(const std::string& path)
+  : m_file(path, O_WRONLY | O_CREAT | O_TRUNC),
+    m_end(0),
+    m_closed(false) {}
+
+Writer::~Writer() {
+  if (!m_closed)
+    ::unlink(m_file.path().c_str());
+}
+
+void Writer::add(const std::string& name, const FastArrayView& v) {
+  Entry entry;
+  entry.name = std::string(name).append(NPY_SUFFIX);
+  entry.size = HEADER_BYTES + static_cast<uint64_t>(v.size()) * sizeof(ScalarT);
+  entry.offset = m_end;
+  const bool zip64 = entry.size >= MAX_32;
+
+  // local header, with its extra fields padding the data to 64 bytes
+  std::string local;
+  put_le(&local, LOCAL_HEADER, 4);
+  put_le(&local, zip64 ? 45 : 20, 2);  // version needed
+  put_le(&local, 0, 2);                // flags
+  put_le(&local, 0, 2);                // stored
+  put_le(&local, 0, 2);                // time
+  put_le(&local, DOS_DATE_1980, 2);
+  put_le(&local, 0, 4);                // crc, patched below
+  put_le(&local, zip64 ? MAX_32 : entry.size, 4);
+  put_le(&local, zip64 ? MAX_32 : entry.size, 4);
+  put_le(&local, entry.name.size(), 2);
+  const size_t fixed = 30 + entry.name.size() + (zip64 ? 20 : 0) + 4;
+  const size_t padding = (64 - (entry.offset + fixed) % 64) % 64;
+  put_le(&local, fixed - 30 - entry.name.size() + padding, 2);
+  local.append(entry.name);
+  if (zip64) {
+    put_le(&local, ZIP64_EXTRA, 2);
+    put_le(&local, 16, 2);
+    put_le(&local, entry.size, 8);
+    put_le(&local, entry.size, 8);
+  }
+  put_le(&local, PADDING_EXTRA, 2);
+  put_le(&local, padding, 2);
+  local.append(padding, '\0');
+  m_file.write_at(local.data(), local.size(), entry.offset);
+
+  // the .npy image, in chunks
+  uint64_t p = entry.offset + local.size();
+  const std::string header = npy_header(v.size());
+  m_file.write_at(header.data(), header.size(), p);
+  entry.crc = crc32(0, header.data(), header.size());
+  p += header.size();
+  const char* data = reinterpret_cast<const char*>(v.data());
+  const uint64_t bytes = entry.size - HEADER_BYTES;
+  for (uint64_t offset = 0; offset < bytes; offset += CHUNK_BYTES) {
+    const size_t n = std::min<uint64_t>(CHUNK_BYTES, bytes - offset);
+    entry.crc = crc32(entry.crc, data + offset, n);
+    m_file.write_at(data + offset, n, p + offset);
+  }
+  m_end = p + bytes;
+
+  std::string crc;
+  put_le(&crc, entry.crc, 4);
+  m_file.write_at(crc.data(), crc.size(), entry.offset + 14);
+  m_entries.push_back(entry);
+}
+
+void Writer::close() {
+  std::string directory;
+  for (size_t k = 0; k < m_entries.size(); ++k) {
+    const Entry& e = m_entries[k];
+    const bool large_size = e.size >= MAX_32;
+    const bool large_offset = e.offset >= MAX_32;
+    std::string extra;
+    if (large_size || large_offset) {
+      put_le(&extra, ZIP64_EXTRA, 2);
+      put_le(&extra, (large_size ? 16 : 0) + (large_offset ? 8 : 0), 2);
+      if (large_size) {
+        put_le(&extra, e.size, 8);
+        put_le(&extra, e.size, 8);
+      }
+      if (large_offset)
+        put_le(&extra, e.offset, 8);
+    }
+    put_le(&directory, CENTRAL_HEADER, 4);
+    put_le(&directory, extra.empty() ? 20 : 45, 2);  // version made by
+    put_le(&directory, extra.empty() ? 20 : 45, 2);  // version needed
+    put_le(&directory, 0, 2);                        // flags
+    put_le(&directory, 0, 2);                        // stored
+    put_le(&directory, 0, 2);                        // time
+    put_le(&directory, DOS_DATE_1980, 2);
+    put_le(&directory, e.crc, 4);
+    put_le(&directory, large_size ? MAX_32 : e.size, 4);
+    put_le(&directory, large_size ? MAX_32 : e.size, 4);
+    put_le(&directory, e.name.size(), 2);
+    put_le(&directory, extra.size(), 2);
+    put_le(&directory, 0, 2);                        // comment
+    put_le(&directory, 0, 2);                        // disk
+    put_le(&directory, 0, 2);                        // internal attributes
+    put_le(&directory, 0, 4);                        // external attributes
+    put_le(&directory, large_offset ? MAX_32 : e.offset, 4);
+    directory.append(e.name).append(extra);
+  }
+
+  const uint64_t entries = m_entries.size();
+  const uint64_t start = m_end;
+  const uint64_t length = directory.size();
+  if (entries >= MAX_16 || start >= MAX_32 || length >= MAX_32) {
+    const uint64_t record = start + length;
+    put_le(&directory, ZIP64_END_OF_DIRECTORY, 4);
+    put_le(&directory, 44, 8);      // size of the rest of the record
+    put_le(&directory, 45, 2);      // version made by
+    put_le(&directory, 45, 2);      // version needed
+    put_le(&directory, 0, 4);       // disk
+    put_le(&directory, 0, 4);       // directory disk
+    put_le(&directory, entries, 8);
+    put_le(&directory, entries, 8);
+    put_le(&directory, length, 8);
+    put_le(&directory, start, 8);
+    put_le(&directory, ZIP64_LOCATOR, 4);
+    put_le(&directory, 0, 4);       // disk of the zip64 record
+    put_le(&directory, record, 8);
+    put_le(&directory, 1, 4);       // disks
+  }
+  put_le(&directory, END_OF_DIRECTORY, 4);
+  put_le(&directory, 0, 2);         // disk
+  put_le(&directory, 0, 2);         // directory disk
+  put_le(&directory, std::min(entries, MAX_16), 2);
+  put_le(&directory, std::min(entries, MAX_16), 2);
+  put_le(&directory, std::min(length, MAX_32), 4);
+  put_le(&directory, std::min(start, MAX_32), 4);
+  put_le(&directory, 0, 2);         // comment
+  m_file.write_at(directory.data(), directory.size(), start);
+  m_file.close();
+  m_closed = true;
+}
+
+}  // namespace npz
+}  // namespace fa
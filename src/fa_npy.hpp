@@ -0,0 +1,183 @@
+// Copyright 2011 Patrick K. Notz
+#ifndef SRC_FA_NPY_HPP_
+#define SRC_FA_NPY_HPP_
+
+#include <FastArray.hpp>
+#include <fa_io.hpp>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fa {
+namespace npy {
+
+//
+// NumPy .npy files (format versions 1.0 to 3.0). Arrays of any shape
+// load as a flat FastArray in storage order; fortran_order tells the
+// caller which order that is. Any integer or floating-point dtype of
+// either byte order loads by conversion, while native float64 can be
+// mapped as a FastArrayView without a copy. Files written here are
+// version 1.0 '<f8' (on little-endian hosts) with the data starting on
+// a 64-byte boundary. Errors throw fa::io::io_error.
+//
+struct Info {
+  std::string descr;           // dtype, e.g. "<f8"
+  bool fortran_order;
+  std::vector<uint64_t> shape;
+  uint64_t size;               // elements, the product of shape
+  uint64_t data_offset;        // bytes from the start of the image
+};
+
+// Parses the header of an .npy image of available bytes, checking
+// that the image holds all of the data
+Info parse_header(const char* data, const size_t available);
+
+// True if elements of this dtype can be viewed as ScalarT in place
+bool is_native(const Info& info);
+
+// Converts the info.size elements at data to ScalarT
+void convert(const Info& info, const char* data, ScalarT* out);
+
+Info read_info(const std::string& path);
+
+// Writes v as a 1-D array
+void save(const std::string& path, const FastArrayView& v);
+
+// Reads path into out, resizing it and converting the dtype
+void load(const std::string& path, FastArray* out);
+
+//
+// MappedArray - an .npy file of native float64 mapped read-only;
+// pages are read on first access
+//
+class MappedArray {
+ public:
+  explicit MappedArray(const std::string& path);
+  // maps an open file; the file may be closed afterwards
+  explicit MappedArray(const io::File& file);
+
+  const Info& info() const {
+    return m_info;
+  }
+
+  const FastArrayView& view() const {
+    return m_view;
+  }
+
+ private:
+  MappedArray(const MappedArray&);
+  MappedArray& operator=(const MappedArray&);
+
+  const io::Mapping m_mapping;
+  const Info m_info;
+  const FastArrayView m_view;
+};
+
+//
+// Writer - writes a 1-D .npy file from consecutive chunks, so arrays
+// larger than memory can be produced piece by piece; the shape is
+// filled in by close(), and only then is the file valid
+//
+class Writer {
+ public:
+  explicit Writer(const std::string& path);
+  // removes the file if close() did not complete
+  ~Writer();
+
+  void write(const FastArrayView& chunk);
+  void close();
+
+  uint64_t size() const {
+    return m_size;
+  }
+
+ private:
+  Writer(const Writer&);
+  Writer& operator=(const Writer&);
+
+  io::File m_file;
+  uint64_t m_size;
+  bool m_closed;
+};
+
+}  // namespace npy
+
+namespace npz {
+
+//
+// NumPy .npz archives -- zip files of .npy members, as written by
+// numpy.savez. Members must be stored (uncompressed); ZIP64 archives
+// are supported, so members and archives may exceed 4 GiB. Names are
+// given without the .npy suffix, as numpy.load reports them.
+//
+class Archive {
+ public:
+  explicit Archive(const std::string& path);
+  // maps an open file; the file may be closed afterwards
+  explicit Archive(const io::File& file);
+
+  std::vector<std::string> names() const;
+  bool contains(const std::string& name) const;
+  npy::Info info(const std::string& name) const;
+
+  // Zero-copy view of a native float64 member; throws if the member
+  // needs conversion or its data is not aligned for ScalarT
+  FastArrayView view(const std::string& name) const;
+
+  // Reads a member into out, converting the dtype
+  void load(const std::string& name, FastArray* out) const;
+
+ private:
+  Archive(const Archive&);
+  Archive& operator=(const Archive&);
+
+  struct Member {
+    uint64_t offset;  // of the .npy image in the archive
+    uint64_t size;
+    bool stored;
+  };
+  const Member& member(const std::string& name) const;
+
+  const std::string m_path;
+  const io::Mapping m_mapping;
+  std::map<std::string, Member> m_members;
+};
+
+//
+// Writer - writes an uncompressed .npz; each member is streamed to
+// disk in large chunks, and its .npy data starts on a 64-byte
+// boundary of the archive so that it can be mapped without a copy.
+// The archive is readable only once close() writes its directory.
+//
+class Writer {
+ public:
+  explicit Writer(const std::string& path);
+  // removes the archive if close() did not complete
+  ~Writer();
+
+  void add(const std::string& name, const FastArrayView& v);
+  // Writes the central directory
+  void close();
+
+ private:
+  Writer(const Writer&);
+  Writer& operator=(const Writer&);
+
+  struct Entry {
+    std::string name;
+    uint32_t crc;
+    uint64_t size;
+    uint64_t offset;
+  };
+
+  io::File m_file;
+  uint64_t m_end;
+  std::vector<Entry> m_entries;
+  bool m_closed;
+};
+
+}  // namespace npz
+}  // namespace fa
+
+#endif  // SRC_FA_NPY_HPP_
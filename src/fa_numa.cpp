@@ -0,0 +1,84 @@
+// Copyright 2011 Patrick K. Notz
+#include <fa_numa.hpp>
+#include <fa_parallel.hpp>
+#include <sys/mman.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <new>
+
+namespace fa {
+
+namespace {
+
+size_t mapped_bytes(const IndexT n) {
+  const size_t page = NumaAllocator::HUGE_PAGE_BYTES;
+  return (static_cast<size_t>(n) * sizeof(ScalarT) + page - 1) / page * page;
+}
+
+// Writes one element of each page that starts in [r.begin, r.end),
+// and the first element, whose page may start in the part before
+void touch(ScalarT* x, const range r) {
+  if (r.begin == r.end)
+    return;
+  const IndexT page =
+      static_cast<IndexT>(::sysconf(_SC_PAGESIZE) / sizeof(ScalarT));
+  x[r.begin] = 0;
+  for (IndexT i = (r.begin + page - 1) / page * page; i < r.end; i += page)
+    x[i] = 0;
+}
+
+}  // namespace
+
+const size_t NumaAllocator::HUGE_PAGE_BYTES;
+
+NumaAllocator::NumaAllocator() : m_huge_pages(true) {}
+
+NumaAllocator::NumaAllocator(const bool huge_pages)
+  : m_huge_pages(huge_pages) {}
+
+bool NumaAllocator::is_mapped(const IndexT n) {
+  return static_cast<size_t>(n) * sizeof(ScalarT) >= HUGE_PAGE_BYTES;
+}
+
+ScalarT* NumaAllocator::allocate(const IndexT n) {
+  if (!is_mapped(n))
+    return heap_allocator()->allocate(n);
+  // map a huge page more than needed and trim both ends to alignment
+  const size_t length = mapped_bytes(n);
+  void* mapped = ::mmap(0, length + HUGE_PAGE_BYTES, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapped == MAP_FAILED)
+    throw std::bad_alloc();
+  char* base = static_cast<char*>(mapped);
+  const uintptr_t address = reinterpret_cast<uintptr_t>(base);
+  char* aligned = base + (HUGE_PAGE_BYTES - address % HUGE_PAGE_BYTES) %
+                         HUGE_PAGE_BYTES;
+  if (aligned != base)
+    ::munmap(base, aligned - base);
+  const size_t tail = base + length + HUGE_PAGE_BYTES - (aligned + length);
+  if (tail != 0)
+    ::munmap(aligned + length, tail);
+#if defined(MADV_HUGEPAGE)
+  // advice only: without THP support the array gets small pages
+  if (m_huge_pages)
+    ::madvise(aligned, length, MADV_HUGEPAGE);
+#endif
+
+  ScalarT* x = reinterpret_cast<ScalarT*>(aligned);
+#if defined(_OPENMP)
+#pragma omp parallel
+  touch(x, partition(n, omp_get_num_threads(), omp_get_thread_num()));
+#else
+  touch(x, partition(n, 1, 0));
+#endif
+  return x;
+}
+
+void NumaAllocator::deallocate(ScalarT* p, const IndexT n) {
+  if (!is_mapped(n))
+    heap_allocator()->deallocate(p, n);
+  else
+    ::munmap(p, mapped_bytes(n));
+}
+
+}  // namespace fa
@@ -0,0 +1,57 @@
+// Copyright 2011 Patrick K. Notz
+#ifndef SRC_FA_NUMA_HPP_
+#define SRC_FA_NUMA_HPP_
+
+#include <FastArray.hpp>
+#include <cstddef>
+
+namespace fa {
+
+//
+// NumaAllocator - places large arrays for parallel evaluation. new[]
+// leaves each page to be placed on the NUMA node of the first thread
+// that writes it, which for an array filled serially is one node for
+// all of it, so parallel evaluation on a multi-socket machine runs at
+// one socket's bandwidth. This allocator maps arrays of at least
+// HUGE_PAGE_BYTES itself, aligned to a huge page, asks for transparent
+// huge pages (madvise), and first-touches the pages from an OpenMP
+// parallel region with the same partition() as fa::parallel, so each
+// thread's part of the array is local to it (up to the one huge page
+// straddling each boundary between parts). Smaller arrays come from
+// new[].
+//
+// Locality holds only while threads stay on their cores and parallel
+// regions use the same thread count, e.g. OMP_PROC_BIND=close with a
+// fixed OMP_NUM_THREADS.
+//
+//   fa::NumaAllocator numa;
+//   fa::FastArray u(n, &numa), v(n, &numa);
+//   fa::parallel(u) = 2.0 * v;
+//
+class NumaAllocator : public Allocator {
+ public:
+  static const size_t HUGE_PAGE_BYTES = 2 << 20;
+
+  NumaAllocator();
+  explicit NumaAllocator(const bool huge_pages);
+
+  ScalarT* allocate(const IndexT n);
+  void deallocate(ScalarT* p, const IndexT n);
+
+  bool huge_pages() const {
+    return m_huge_pages;
+  }
+
+  // True if arrays of n elements are mapped and first-touched here
+  static bool is_mapped(const IndexT n);
+
+ private:
+  NumaAllocator(const NumaAllocator&);
+  NumaAllocator& operator=(const NumaAllocator&);
+
+  const bool m_huge_pages;
+};
+
+}  // namespace fa
+
+#endif  // SRC_FA_NUMA_HPP_
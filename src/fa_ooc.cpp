@@ -0,0 +1,46 @@
+// Copyright 2011 Patrick K. Notz
+#include <fa_ooc.hpp>
+#include <fa_npy.hpp>
+#include <fcntl.h>
+#include <cstring>
+#include <limits>
+
+namespace fa {
+namespace ooc {
+
+Input::Input(const std::string& path)
+  : m_file(path, O_RDONLY),
+    m_offset(0),
+    m_size(0) {
+  char magic[6] = { 0 };
+  if (m_file.size() >= sizeof(magic))
+    m_file.read_at(magic, sizeof(magic), 0);
+  if (std::memcmp(magic, "\x93NUMPY", sizeof(magic)) == 0) {
+    // only the header is touched, so mapping the whole file is cheap
+    const io::Mapping mapping(m_file, m_file.size());
+    const npy::Info info = npy::parse_header(mapping.data(), mapping.size());
+    if (!npy::is_native(info))
+      throw io::io_error("out-of-core operands must be native float64: ",
+                         path);
+    if (info.size > static_cast<uint64_t>(std::numeric_limits<IndexT>::max()))
+      throw io::io_error("too many elements for IndexT: ", path);
+    m_offset = info.data_offset;
+    m_size = static_cast<IndexT>(info.size);
+  } else {
+    const io::Header h = io::read_header(m_file);
+    if (h.codec != io::CODEC_NONE)
+      throw io::io_error("out-of-core operands cannot be encoded: ", path);
+    m_offset = h.header_bytes;
+    m_size = static_cast<IndexT>(h.size);
+  }
+  // the whole file is read once, front to back
+  ::posix_fadvise(m_file.fd(), 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+void Input::read(const IndexT begin, const IndexT n, ScalarT* out) const {
+  m_file.read_at(out, static_cast<size_t>(n) * sizeof(ScalarT),
+                 m_offset + static_cast<uint64_t>(begin) * sizeof(ScalarT));
+}
+
+}  // namespace ooc
+}  // namespace fa
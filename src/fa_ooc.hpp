@@ -0,0 +1,155 @@
+// Copyright 2011 Patrick K. Notz
+#ifndef SRC_FA_OOC_HPP_
+#define SRC_FA_OOC_HPP_
+
+#include <FastArray.hpp>
+#include <fa_io.hpp>
+#include <fa_parallel.hpp>
+#include <stdint.h>
+#include <algorithm>
+#include <future>
+#include <stdexcept>
+#include <string>
+
+namespace fa {
+namespace ooc {
+
+//
+// Out-of-core evaluation -- expressions over arrays too large for
+// memory, evaluated one chunk at a time. Operands are files, and
+// each chunk of them is presented to the expression as a FastArrayView,
+// so the expression code is the same as for arrays in memory:
+//
+//   fa::ooc::Input a("a.fa"), b("b.fa");
+//   fa::io::Writer out("out.fa");
+//   fa::ooc::evaluate(&out, fa::ooc::DEFAULT_CHUNK,
+//                     [](const fa::FastArrayView& a,
+//                        const fa::FastArrayView& b) {
+//                       return a + 2.0 * b;
+//                     }, a, b);
+//   out.close();
+//
+// Reads and writes are double buffered and run on their own threads:
+// while chunk k is evaluated (with fa::parallel), chunk k+1 is read
+// and chunk k-1 is written, so a disk-bound evaluation proceeds at
+// disk bandwidth. Memory use is two chunks per input plus two for
+// the result.
+//
+
+// Elements per chunk, 8 MiB of each operand: large enough for
+// sequential disk transfers, small enough to stay out of the way
+const IndexT DEFAULT_CHUNK = 1 << 20;
+
+//
+// Input - a read-only array in a file: a FastArray binary file
+// (fa_io.hpp) or a native float64 .npy file. Reads are positional,
+// so they may run on any thread.
+//
+class Input {
+ public:
+  explicit Input(const std::string& path);
+
+  const std::string& path() const {
+    return m_file.path();
+  }
+
+  IndexT size() const {
+    return m_size;
+  }
+
+  // Reads elements [begin, begin + n) into out
+  void read(const IndexT begin, const IndexT n, ScalarT* out) const;
+
+ private:
+  Input(const Input&);
+  Input& operator=(const Input&);
+
+  io::File m_file;
+  uint64_t m_offset;  // of the first element
+  IndexT m_size;
+};
+
+namespace detail {
+
+template <class F, int... N>
+auto apply(const F& f, const FastArray* buffers, const IndexT n,
+           indices<N...>)
+    -> decltype(f(FastArrayView(buffers[N].data(), n)...)) {
+  return f(FastArrayView(buffers[N].data(), n)...);
+}
+
+}  // namespace detail
+
+//
+// evaluate - out receives f(a, b, ...) over the inputs, which must all
+// be the same size, chunk elements at a time. f is called once per
+// chunk with a FastArrayView of each input and returns an expression
+// (or a view) of the same size; it should refer to no other arrays.
+// Writer is anything with write(const FastArrayView&), such as
+// io::Writer or npy::Writer; chunks are written in order and the
+// writer is left open. Errors of any thread are rethrown here.
+//
+template <class Writer, class F, class... In>
+void evaluate(Writer* out, const IndexT chunk, const F& f,
+              const In&... inputs) {
+  static const int N = sizeof...(In);
+  static_assert(N > 0, "evaluate needs at least one input");
+  if (chunk <= 0)
+    throw std::invalid_argument("ooc::evaluate: chunk must be positive");
+  const Input* const in[N] = { &inputs... };
+  const IndexT size = in[0]->size();
+  for (int j = 1; j < N; ++j)
+    if (in[j]->size() != size)
+      throw std::length_error(
+          std::string("ooc::evaluate: size mismatch of ").append(
+              in[j]->path()));
+
+  const IndexT length = std::min(chunk, size);
+  FastArray buffers[2][N];
+  FastArray results[2];
+  for (int s = 0; s < 2; ++s) {
+    for (int j = 0; j < N; ++j)
+      buffers[s][j].resize(length);
+    results[s].resize(length);
+  }
+
+  // chunk [begin, begin + n) of every input into buffers[s]
+  auto read = [&](const int s, const IndexT begin, const IndexT n) {
+    for (int j = 0; j < N; ++j)
+      in[j]->read(begin, n, buffers[s][j].data());
+  };
+
+  std::future<void> reading, writing;
+  if (size > 0)
+    reading = std::async(std::launch::async, read, 0, 0, length);
+  for (IndexT begin = 0, k = 0; begin < size; begin += chunk, ++k) {
+    const int s = k % 2;
+    const IndexT n = std::min(chunk, size - begin);
+    reading.get();
+    // buffers[1 - s] was consumed by the previous chunk
+    const IndexT next = begin + n;
+    if (next < size)
+      reading = std::async(std::launch::async, read, 1 - s, next,
+                           std::min(chunk, size - next));
+
+    // results[s] was last written two chunks ago, and that write has
+    // been waited for
+    results[s].resize(n);
+    parallel(results[s]).evaluate<assign_op>(
+        detail::apply(f, buffers[s], n,
+                      typename make_indices<N>::type()));
+
+    if (writing.valid())
+      writing.get();
+    const FastArrayView result(results[s].data(), n);
+    writing = std::async(std::launch::async,
+                         [out, result]() { out->write(result); });
+  }
+  if (writing.valid())
+    writing.get();
+}
+
+}  // namespace ooc
+}  // namespace fa
+
+#endif  // SRC_FA_OOC_HPP_
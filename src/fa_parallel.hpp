@@ -0,0 +1,119 @@
+// Copyright 2011 Patrick K. Notz
+#ifndef SRC_FA_PARALLEL_HPP_
+#define SRC_FA_PARALLEL_HPP_
+
+#include <FastArray.hpp>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+#include <algorithm>
+
+namespace fa {
+
+//
+// Static partition -- part k of parts of [0, n). Boundaries fall on
+// multiples of a cache line's worth of elements, so parts of a
+// line-aligned array never share a line: no false sharing, and
+// streaming stores stay whole lines. Every code path that splits an
+// array between threads should use it, so that a thread touches the
+// same elements in every loop.
+//
+struct range {
+  IndexT begin;
+  IndexT end;
+};
+
+inline range partition(const IndexT n, const int parts, const int k) {
+  const IndexT line = 64 / sizeof(ScalarT);
+  const IndexT lines = (n + line - 1) / line;
+  const IndexT per_part = lines / parts;
+  const IndexT extra = lines % parts;
+  // the first `extra` parts get one more line
+  const IndexT first = k * per_part + std::min<IndexT>(k, extra);
+  const IndexT count = per_part + (k < extra ? 1 : 0);
+  const range r = { std::min(n, first * line),
+                    std::min(n, (first + count) * line) };
+  return r;
+}
+
+// Threads a parallel evaluation will use
+inline int num_threads() {
+#if defined(_OPENMP)
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+//
+// Parallel assignment -- parallel(u) = expr evaluates expr with one
+// partition() of u per OpenMP thread, following the same streaming
+// threshold as FastArray::operator=. Without OpenMP it evaluates
+// serially.
+//
+struct parallel_ref {
+  explicit parallel_ref(FastArray& fa) : m_fa(fa) {}
+
+  template <class T>
+  parallel_ref& operator=(const T& rhs) {
+    const IndexT n = m_fa.size();
+    if (static_cast<size_t>(n) * sizeof(ScalarT) >= streaming_threshold())
+      stream(rhs);
+    else
+      evaluate<assign_op>(rhs);
+    return *this;
+  }
+
+  // u[i] op= rhs[i] with cached stores
+  template <class Op, class T>
+  void evaluate(const T& rhs) {
+    const term<typename operand<T>::type> t(rhs);
+    FA_INSTRUMENT_PARALLEL(parallel_ref(Op, term<T>), Op::symbol(),
+                           &signature<T>, m_fa.size());
+    // so that the threads find it unshared
+    m_fa.unshare();
+#if defined(_OPENMP)
+#pragma omp parallel
+    {
+      FA_INSTRUMENT_PART()
+      const range r = partition(m_fa.size(), omp_get_num_threads(),
+                                omp_get_thread_num());
+      m_fa.evaluate<Op>(t, r.begin, r.end);
+    }
+#else
+    FA_INSTRUMENT_PART()
+    m_fa.evaluate<Op>(t, 0, m_fa.size());
+#endif
+  }
+
+  // u[i] = rhs[i] with streaming stores
+  template <class T>
+  void stream(const T& rhs) {
+    const term<typename operand<T>::type> t(rhs);
+    FA_INSTRUMENT_PARALLEL(parallel_ref(streaming_ref, term<T>), "stream=",
+                           &signature<T>, m_fa.size());
+    m_fa.unshare();
+#if defined(_OPENMP)
+#pragma omp parallel
+    {
+      FA_INSTRUMENT_PART()
+      const range r = partition(m_fa.size(), omp_get_num_threads(),
+                                omp_get_thread_num());
+      m_fa.stream(t, r.begin, r.end);
+    }
+#else
+    FA_INSTRUMENT_PART()
+    m_fa.stream(t, 0, m_fa.size());
+#endif
+  }
+
+  FastArray& m_fa;
+};
+
+inline parallel_ref parallel(FastArray& fa) {
+  return parallel_ref(fa);
+}
+
+}  // namespace fa
+
+#endif  // SRC_FA_PARALLEL_HPP_
@@ -0,0 +1,310 @@
+// Copyright 2011 Patrick K. Notz
+#include <fa_perf.hpp>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#endif
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <typeindex>
+#include <vector>
+
+namespace fa {
+namespace perf {
+
+const char* counter_name(const Counter counter) {
+  static const char* names[NUM_COUNTERS] = {
+    "task_clock_ns", "cycles", "instructions", "cache_misses",
+    "vector_instructions"
+  };
+  return names[counter];
+}
+
+namespace {
+
+bool is_intel() {
+#if defined(__i386__) || defined(__x86_64__)
+  unsigned eax, ebx, ecx, edx;
+  if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx))
+    return false;
+  return ebx == 0x756e6547 && edx == 0x49656e69 && ecx == 0x6c65746e;
+#else
+  return false;
+#endif
+}
+
+#if defined(__linux__)
+// Fills in the event for `counter`; returns false if there is none
+bool event_for(const Counter counter, perf_event_attr* attr) {
+  std::memset(attr, 0, sizeof(*attr));
+  attr->size = sizeof(*attr);
+  attr->type = PERF_TYPE_HARDWARE;
+  switch (counter) {
+    case TASK_CLOCK:
+      attr->type = PERF_TYPE_SOFTWARE;
+      attr->config = PERF_COUNT_SW_TASK_CLOCK;
+      return true;
+    case CYCLES:
+      attr->config = PERF_COUNT_HW_CPU_CYCLES;
+      return true;
+    case INSTRUCTIONS:
+      attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+      return true;
+    case CACHE_MISSES:
+      attr->config = PERF_COUNT_HW_CACHE_MISSES;
+      return true;
+    case VECTOR_INSTRUCTIONS: {
+      const char* raw = std::getenv("FA_PERF_VECTOR_EVENT");
+      attr->type = PERF_TYPE_RAW;
+      if (raw) {
+        attr->config = std::strtoull(raw, 0, 16);
+        return attr->config != 0;
+      }
+      // FP_ARITH_INST_RETIRED, every packed single/double width
+      attr->config = 0xfcc7;
+      return is_intel();
+    }
+    default:
+      return false;
+  }
+}
+#endif
+
+}  // namespace
+
+CounterGroup::CounterGroup()
+  : m_leader(-1) {
+  for (int c = 0; c < NUM_COUNTERS; ++c) {
+    m_fd[c] = -1;
+    m_id[c] = 0;
+  }
+#if defined(__linux__)
+  for (int c = 0; c < NUM_COUNTERS; ++c) {
+    perf_event_attr attr;
+    if (!event_for(static_cast<Counter>(c), &attr))
+      continue;
+    attr.disabled = m_leader < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+                       PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    m_fd[c] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1,
+                                       m_leader, 0));
+    if (m_fd[c] < 0)
+      continue;
+    if (ioctl(m_fd[c], PERF_EVENT_IOC_ID, &m_id[c]) != 0) {
+      close(m_fd[c]);
+      m_fd[c] = -1;
+      continue;
+    }
+    if (m_leader < 0)
+      m_leader = m_fd[c];
+  }
+#endif
+}
+
+CounterGroup::~CounterGroup() {
+#if defined(__linux__)
+  for (int c = 0; c < NUM_COUNTERS; ++c)
+    if (m_fd[c] >= 0)
+      close(m_fd[c]);
+#endif
+}
+
+bool CounterGroup::available(const Counter counter) const {
+  return m_fd[counter] >= 0;
+}
+
+void CounterGroup::start() {
+#if defined(__linux__)
+  if (m_leader < 0)
+    return;
+  ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+void CounterGroup::stop(Sample* sample) {
+  for (int c = 0; c < NUM_COUNTERS; ++c) {
+    sample->value[c] = 0;
+    sample->valid[c] = false;
+  }
+#if defined(__linux__)
+  if (m_leader < 0)
+    return;
+  ioctl(m_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+  // { nr, time_enabled, time_running, { value, id } [nr] }
+  uint64_t buf[3 + 2 * NUM_COUNTERS];
+  if (read(m_leader, buf, sizeof(buf)) < 0)
+    return;
+  const uint64_t nr = buf[0];
+  const double scale = buf[2] > 0 ? static_cast<double>(buf[1]) / buf[2] : 0;
+  for (uint64_t k = 0; k < nr && k < NUM_COUNTERS; ++k) {
+    for (int c = 0; c < NUM_COUNTERS; ++c) {
+      if (m_fd[c] < 0 || m_id[c] != buf[4 + 2 * k])
+        continue;
+      // scale up if the group was multiplexed off the PMU
+      sample->value[c] = static_cast<uint64_t>(buf[3 + 2 * k] * scale);
+      sample->valid[c] = true;
+    }
+  }
+#endif
+}
+
+CounterGroup& thread_counters() {
+  static thread_local CounterGroup counters;
+  return counters;
+}
+
+std::string demangle(const char* name) {
+#if defined(__GNUC__)
+  int status = 0;
+  char* demangled = abi::__cxa_demangle(name, 0, 0, &status);
+  if (status == 0 && demangled) {
+    std::string result(demangled);
+    std::free(demangled);
+    return result;
+  }
+#endif
+  return name;
+}
+
+namespace {
+
+struct Registry {
+  ~Registry();
+  std::mutex mutex;
+  std::map<std::type_index, Record> records;
+};
+
+Registry registry;
+
+}  // namespace
+
+void record(const std::type_info& type, const uint64_t elements,
+            const Sample& sample) {
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  std::map<std::type_index, Record>::iterator it =
+      registry.records.find(std::type_index(type));
+  if (it == registry.records.end()) {
+    Record r;
+    r.expression = demangle(type.name());
+    r.calls = 0;
+    r.elements = 0;
+    for (int c = 0; c < NUM_COUNTERS; ++c) {
+      r.total[c] = 0;
+      r.valid[c] = sample.valid[c];
+    }
+    it = registry.records.insert(std::make_pair(std::type_index(type), r))
+             .first;
+  }
+  Record& r = it->second;
+  ++r.calls;
+  r.elements += elements;
+  for (int c = 0; c < NUM_COUNTERS; ++c) {
+    r.total[c] += sample.value[c];
+    r.valid[c] = r.valid[c] && sample.valid[c];
+  }
+}
+
+ParallelMeasurement::ParallelMeasurement(const std::type_info& type,
+                                         const uint64_t elements)
+  : m_type(type),
+    m_elements(elements),
+    m_any(false) {
+  for (int c = 0; c < NUM_COUNTERS; ++c) {
+    m_total.value[c] = 0;
+    m_total.valid[c] = false;
+  }
+}
+
+ParallelMeasurement::~ParallelMeasurement() {
+  record(m_type, m_elements, m_total);
+}
+
+// A counter is valid only if every part measured it
+void ParallelMeasurement::add(const Sample& part) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (int c = 0; c < NUM_COUNTERS; ++c) {
+    m_total.value[c] += part.value[c];
+    m_total.valid[c] = (m_any ? m_total.valid[c] : true) && part.valid[c];
+  }
+  m_any = true;
+}
+
+std::vector<Record> records() {
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  std::vector<Record> result;
+  for (std::map<std::type_index, Record>::const_iterator it =
+           registry.records.begin(); it != registry.records.end(); ++it)
+    result.push_back(it->second);
+  return result;
+}
+
+void reset() {
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.records.clear();
+}
+
+void dump(std::ostream& os) {
+  const std::vector<Record> all = records();
+  os << "fa::perf summary (" << all.size() << " expression types)\n";
+  for (size_t k = 0; k < all.size(); ++k) {
+    const Record& r = all[k];
+    os << r.expression << "\n"
+       << "    calls " << r.calls << ", elements " << r.elements << "\n";
+    for (int c = 0; c < NUM_COUNTERS; ++c) {
+      os << "    " << std::setw(20) << std::left
+         << counter_name(static_cast<Counter>(c));
+      if (r.valid[c]) {
+        os << std::setw(16) << r.total[c] << std::setprecision(4)
+           << static_cast<double>(r.total[c]) / std::max<uint64_t>(
+                  r.elements, 1) << " per element";
+      } else {
+        os << "unavailable";
+      }
+      os << "\n";
+    }
+    const Counter ipc[2] = { INSTRUCTIONS, CYCLES };
+    if (r.valid[ipc[0]] && r.valid[ipc[1]] && r.total[ipc[1]] > 0)
+      os << "    IPC " << std::setprecision(3)
+         << static_cast<double>(r.total[ipc[0]]) / r.total[ipc[1]] << "\n";
+  }
+}
+
+namespace {
+
+Registry::~Registry() {
+  if (records.empty())
+    return;
+  // records() locks the mutex; the registry is still fully alive here
+  const char* path = std::getenv("FA_PERF_OUTPUT");
+  if (path) {
+    std::ofstream out(path);
+    dump(out);
+  } else {
+    dump(std::cerr);
+  }
+}
+
+}  // namespace
+
+}  // namespace perf
+}  // namespace fa
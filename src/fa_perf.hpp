@@ -0,0 +1,160 @@
+// Copyright 2011 Patrick K. Notz
+#ifndef SRC_FA_PERF_HPP_
+#define SRC_FA_PERF_HPP_
+
+#include <stdint.h>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+namespace fa {
+namespace perf {
+
+//
+// Hardware performance counters for expression evaluation, read
+// through Linux perf_event_open. Compile with -DFA_PERF_COUNTERS to
+// have FastArray assignments record counts per expression type; a
+// summary is written at exit to the file named by $FA_PERF_OUTPUT,
+// or to stderr.
+//
+// Counters the kernel or CPU does not provide (e.g. inside most
+// virtual machines) are reported as unavailable. The vector
+// instruction count uses a model-specific raw event: by default
+// FP_ARITH_INST_RETIRED (all packed widths) on Intel CPUs, or the
+// raw config in $FA_PERF_VECTOR_EVENT (hex) on any CPU.
+//
+enum Counter {
+  TASK_CLOCK,
+  CYCLES,
+  INSTRUCTIONS,
+  CACHE_MISSES,
+  VECTOR_INSTRUCTIONS,
+  NUM_COUNTERS
+};
+
+const char* counter_name(const Counter counter);
+
+struct Sample {
+  uint64_t value[NUM_COUNTERS];
+  bool valid[NUM_COUNTERS];
+};
+
+//
+// CounterGroup - the counters of the calling thread, scheduled
+// together as one perf event group
+//
+class CounterGroup {
+ public:
+  CounterGroup();
+  ~CounterGroup();
+
+  bool available(const Counter counter) const;
+  void start();
+  void stop(Sample* sample);
+
+ private:
+  CounterGroup(const CounterGroup&);
+  CounterGroup& operator=(const CounterGroup&);
+
+  int m_fd[NUM_COUNTERS];
+  uint64_t m_id[NUM_COUNTERS];
+  int m_leader;
+};
+
+// The calling thread's counter group
+CounterGroup& thread_counters();
+
+struct Record {
+  std::string expression;  // demangled expression type
+  uint64_t calls;
+  uint64_t elements;
+  uint64_t total[NUM_COUNTERS];
+  bool valid[NUM_COUNTERS];
+};
+
+// Adds one evaluation of expression type `type` (thread-safe)
+void record(const std::type_info& type, const uint64_t elements,
+            const Sample& sample);
+
+std::vector<Record> records();
+void reset();
+void dump(std::ostream& os);
+
+std::string demangle(const char* name);
+
+//
+// ScopedMeasurement - counts the enclosing scope and records it
+// against `type` on destruction
+//
+class ScopedMeasurement {
+ public:
+  ScopedMeasurement(const std::type_info& type, const uint64_t elements)
+    : m_type(type),
+      m_elements(elements) {
+    thread_counters().start();
+  }
+
+  ~ScopedMeasurement() {
+    Sample sample;
+    thread_counters().stop(&sample);
+    record(m_type, m_elements, sample);
+  }
+
+ private:
+  ScopedMeasurement(const ScopedMeasurement&);
+  ScopedMeasurement& operator=(const ScopedMeasurement&);
+
+  const std::type_info& m_type;
+  const uint64_t m_elements;
+};
+
+//
+// ParallelMeasurement - counts a parallel evaluation. The thread
+// counters only see their own thread, so every thread brackets its
+// part with a Part; the parts' counts are summed and recorded as one
+// call over all the elements when the measurement ends.
+//
+class ParallelMeasurement {
+ public:
+  ParallelMeasurement(const std::type_info& type, const uint64_t elements);
+  ~ParallelMeasurement();
+
+  class Part {
+   public:
+    explicit Part(ParallelMeasurement& measurement)
+      : m_measurement(measurement) {
+      thread_counters().start();
+    }
+    ~Part() {
+      Sample sample;
+      thread_counters().stop(&sample);
+      m_measurement.add(sample);
+    }
+
+   private:
+    Part(const Part&);
+    Part& operator=(const Part&);
+
+    ParallelMeasurement& m_measurement;
+  };
+
+  // Adds one thread's counts (thread-safe)
+  void add(const Sample& part);
+
+ private:
+  ParallelMeasurement(const ParallelMeasurement&);
+  ParallelMeasurement& operator=(const ParallelMeasurement&);
+
+  const std::type_info& m_type;
+  const uint64_t m_elements;
+  std::mutex m_mutex;
+  bool m_any;
+  Sample m_total;
+};
+
+}  // namespace perf
+}  // namespace fa
+
+#endif  // SRC_FA_PERF_HPP_
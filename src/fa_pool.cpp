@@ -0,0 +1,147 @@
+// Copyright 2011 Patrick K. Notz
+#include <fa_pool.hpp>
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+namespace fa {
+namespace pool {
+
+namespace {
+
+const size_t MIN_BYTES = 64;
+// enough classes for any IndexT elements
+const int CLASSES = 8 * sizeof(size_t) - 6;
+
+std::atomic<size_t> g_retain_limit(256u << 20);
+
+int size_class(const IndexT n) {
+  const size_t bytes = static_cast<size_t>(n) * sizeof(ScalarT);
+  int c = 0;
+  while ((MIN_BYTES << c) < bytes)
+    ++c;
+  return c;
+}
+
+// A free buffer holds the link to the next one in its first bytes
+struct Link {
+  Link* next;
+};
+
+// Set once the calling thread's cache is destroyed; arrays freed
+// later, e.g. statics at exit, bypass it
+thread_local bool t_cache_destroyed = false;
+
+ScalarT* heap_allocate(const int c) {
+  void* p;
+  if (::posix_memalign(&p, MIN_BYTES, MIN_BYTES << c) != 0)
+    throw std::bad_alloc();
+  return static_cast<ScalarT*>(p);
+}
+
+struct Cache {
+  Cache() : stats() {
+    for (int c = 0; c < CLASSES; ++c)
+      free_lists[c] = 0;
+  }
+  ~Cache() {
+    release(0);
+    t_cache_destroyed = true;
+  }
+
+  // Frees buffers, largest first, until at most bytes are retained
+  void release(const size_t bytes) {
+    for (int c = CLASSES - 1; c >= 0 && stats.retained_bytes > bytes; --c) {
+      while (free_lists[c] != 0 && stats.retained_bytes > bytes) {
+        Link* link = free_lists[c];
+        free_lists[c] = link->next;
+        ::free(link);
+        stats.retained_bytes -= MIN_BYTES << c;
+        --stats.retained_buffers;
+      }
+    }
+  }
+
+  Link* free_lists[CLASSES];
+  Stats stats;
+};
+
+Cache& cache() {
+  static thread_local Cache c;
+  return c;
+}
+
+class PoolAllocator : public Allocator {
+ public:
+  ScalarT* allocate(const IndexT n) {
+    const int c = size_class(n);
+    if (t_cache_destroyed)
+      return heap_allocate(c);
+    Cache& local = cache();
+    Link* link = local.free_lists[c];
+    if (link != 0) {
+      local.free_lists[c] = link->next;
+      local.stats.retained_bytes -= MIN_BYTES << c;
+      --local.stats.retained_buffers;
+      ++local.stats.hits;
+      return reinterpret_cast<ScalarT*>(link);
+    }
+    ++local.stats.misses;
+    return heap_allocate(c);
+  }
+
+  void deallocate(ScalarT* p, const IndexT n) {
+    if (t_cache_destroyed) {
+      ::free(p);
+      return;
+    }
+    Cache& local = cache();
+    const int c = size_class(n);
+    const size_t bytes = MIN_BYTES << c;
+    if (local.stats.retained_bytes + bytes >
+        g_retain_limit.load(std::memory_order_relaxed)) {
+      ::free(p);
+      return;
+    }
+    Link* link = reinterpret_cast<Link*>(p);
+    link->next = local.free_lists[c];
+    local.free_lists[c] = link;
+    local.stats.retained_bytes += bytes;
+    ++local.stats.retained_buffers;
+  }
+};
+
+}  // namespace
+
+Allocator* allocator() {
+  static PoolAllocator allocator;
+  return &allocator;
+}
+
+Stats stats() {
+  return cache().stats;
+}
+
+void reset_stats() {
+  cache().stats.hits = 0;
+  cache().stats.misses = 0;
+}
+
+void trim() {
+  cache().release(0);
+}
+
+void trim(const size_t bytes) {
+  cache().release(bytes);
+}
+
+size_t retain_limit() {
+  return g_retain_limit.load(std::memory_order_relaxed);
+}
+
+void set_retain_limit(const size_t bytes) {
+  g_retain_limit.store(bytes, std::memory_order_relaxed);
+}
+
+}  // namespace pool
+}  // namespace fa
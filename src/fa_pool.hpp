@@ -0,0 +1,65 @@
+// Copyright 2011 Patrick K. Notz
+#ifndef SRC_FA_POOL_HPP_
+#define SRC_FA_POOL_HPP_
+
+#include <FastArray.hpp>
+#include <stdint.h>
+#include <cstddef>
+
+namespace fa {
+namespace pool {
+
+//
+// A recycling pool for the buffers of arrays that are created and
+// destroyed over and over at the same sizes. Sizes are rounded up to
+// a power of two of at least 64 bytes, and each thread keeps a free
+// list per size class: a released buffer goes on the releasing
+// thread's list, and the next allocation of that class on the thread
+// takes it back, with no locks. Buffers are 64-byte aligned. Each
+// thread retains at most retain_limit() bytes; buffers released
+// beyond that, and a thread's buffers when it exits, go back to the
+// heap.
+//
+// Opt in per array, or for every array constructed without an
+// allocator:
+//
+//   fa::set_default_allocator(fa::pool::allocator());
+//
+// Rounding up costs address space but not memory: the heap maps large
+// buffers lazily, and the tail past an array's end is never touched.
+//
+
+// Counts for the calling thread
+struct Stats {
+  uint64_t hits;            // allocations served from the free lists
+  uint64_t misses;          // allocations that went to the heap
+  size_t retained_bytes;    // on the free lists
+  size_t retained_buffers;
+
+  double hit_rate() const {
+    const uint64_t total = hits + misses;
+    return total == 0 ? 0.0 : static_cast<double>(hits) / total;
+  }
+};
+
+Allocator* allocator();
+
+Stats stats();
+
+// Zeroes the calling thread's hit and miss counts
+void reset_stats();
+
+// Returns the calling thread's retained buffers to the heap, all of
+// them or, largest first, until it retains at most bytes
+void trim();
+void trim(const size_t bytes);
+
+// Per-thread bound on retained bytes, for all threads; lowering it
+// does not trim buffers already retained. Defaults to 256 MiB.
+size_t retain_limit();
+void set_retain_limit(const size_t bytes);
+
+}  // namespace pool
+}  // namespace fa
+
+#endif  // SRC_FA_POOL_HPP_
@@ -0,0 +1,142 @@
+// Copyright 2011 Patrick K. Notz
+#include <fa_profile.hpp>
+#include <fa_perf.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <typeindex>
+#include <vector>
+
+namespace fa {
+namespace profile {
+
+namespace {
+
+struct Registry {
+  ~Registry();
+  std::mutex mutex;
+  std::map<std::type_index, Entry> entries;
+};
+
+Registry registry;
+
+bool by_time(const Entry& a, const Entry& b) {
+  return a.seconds > b.seconds;
+}
+
+// Quotes a string for JSON and CSV
+std::string quoted(const std::string& s, const char escape) {
+  std::string out("\"");
+  for (size_t k = 0; k < s.size(); ++k) {
+    if (s[k] == '"' || s[k] == '\\')
+      out.push_back(s[k] == '"' ? escape : '\\');
+    out.push_back(s[k]);
+  }
+  return out.append("\"");
+}
+
+}  // namespace
+
+void record(const std::type_info& key, const char* label,
+            Signature signature, const uint64_t elements,
+            const double seconds) {
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  std::map<std::type_index, Entry>::iterator it =
+      registry.entries.find(std::type_index(key));
+  if (it == registry.entries.end()) {
+    Entry e;
+    e.label = label;
+    e.signature = signature();
+    e.type = perf::demangle(key.name());
+    e.calls = 0;
+    e.elements = 0;
+    e.seconds = 0;
+    it = registry.entries.insert(std::make_pair(std::type_index(key), e))
+             .first;
+  }
+  ++it->second.calls;
+  it->second.elements += elements;
+  it->second.seconds += seconds;
+}
+
+std::vector<Entry> entries() {
+  std::vector<Entry> result;
+  {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (std::map<std::type_index, Entry>::const_iterator it =
+             registry.entries.begin(); it != registry.entries.end(); ++it)
+      result.push_back(it->second);
+  }
+  std::sort(result.begin(), result.end(), by_time);
+  return result;
+}
+
+void reset() {
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.entries.clear();
+}
+
+void write_json(std::ostream& os) {
+  const std::vector<Entry> all = entries();
+  os << "[\n";
+  for (size_t k = 0; k < all.size(); ++k) {
+    const Entry& e = all[k];
+    char numbers[128];
+    std::snprintf(numbers, sizeof(numbers),
+                  "\"calls\": %llu, \"elements\": %llu, \"seconds\": %.9g",
+                  static_cast<unsigned long long>(e.calls),  // NOLINT
+                  static_cast<unsigned long long>(e.elements),  // NOLINT
+                  e.seconds);
+    os << "  {\"label\": " << quoted(e.label, '\\')
+       << ", \"signature\": " << quoted(e.signature, '\\')
+       << ", " << numbers
+       << ", \"type\": " << quoted(e.type, '\\') << "}"
+       << (k + 1 < all.size() ? ",\n" : "\n");
+  }
+  os << "]\n";
+}
+
+void write_csv(std::ostream& os) {
+  const std::vector<Entry> all = entries();
+  os << "label,signature,calls,elements,seconds,ns_per_element,type\n";
+  for (size_t k = 0; k < all.size(); ++k) {
+    const Entry& e = all[k];
+    char numbers[128];
+    std::snprintf(numbers, sizeof(numbers), "%llu,%llu,%.9g,%.6g",
+                  static_cast<unsigned long long>(e.calls),  // NOLINT
+                  static_cast<unsigned long long>(e.elements),  // NOLINT
+                  e.seconds,
+                  e.elements ? 1e9 * e.seconds / e.elements : 0.0);
+    os << quoted(e.label, '"') << "," << quoted(e.signature, '"') << ","
+       << numbers << "," << quoted(e.type, '"') << "\n";
+  }
+}
+
+namespace {
+
+Registry::~Registry() {
+  if (entries.empty())
+    return;
+  const char* path = std::getenv("FA_PROFILE_OUTPUT");
+  if (!path) {
+    write_csv(std::cerr);
+    return;
+  }
+  std::ofstream out(path);
+  const size_t len = std::strlen(path);
+  if (len >= 4 && std::strcmp(path + len - 4, ".csv") == 0)
+    write_csv(out);
+  else
+    write_json(out);
+}
+
+}  // namespace
+
+}  // namespace profile
+}  // namespace fa
@@ -0,0 +1,80 @@
+// Copyright 2011 Patrick K. Notz
+#ifndef SRC_FA_PROFILE_HPP_
+#define SRC_FA_PROFILE_HPP_
+
+#include <stdint.h>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+namespace fa {
+namespace profile {
+
+//
+// Per-expression-type profiler. Compile with -DFA_PROFILE to have
+// every whole-array evaluation add its wall time and element count
+// to an entry keyed on the assignment and expression type. At exit
+// the profile is written to $FA_PROFILE_OUTPUT (CSV if the name ends
+// in .csv, JSON otherwise), or as CSV to stderr.
+//
+struct Entry {
+  std::string label;      // "=", "+=", "stream=", "tie=", "block", ...
+  std::string signature;  // e.g. log10(exp(A)+cos(B)*pow(C,s)/(-D+s))
+  std::string type;       // demangled C++ type
+  uint64_t calls;
+  uint64_t elements;
+  double seconds;
+};
+
+typedef std::string (*Signature)();
+
+// Adds one evaluation (thread-safe); signature is only called the
+// first time a key is seen
+void record(const std::type_info& key, const char* label,
+            Signature signature, const uint64_t elements,
+            const double seconds);
+
+// Entries sorted by decreasing total time
+std::vector<Entry> entries();
+void reset();
+
+void write_json(std::ostream& os);
+void write_csv(std::ostream& os);
+
+//
+// ScopedTimer - times the enclosing scope and records it on
+// destruction
+//
+class ScopedTimer {
+ public:
+  ScopedTimer(const std::type_info& key, const char* label,
+              Signature signature, const uint64_t elements)
+    : m_key(key),
+      m_label(label),
+      m_signature(signature),
+      m_elements(elements),
+      m_start(std::chrono::steady_clock::now()) {}
+
+  ~ScopedTimer() {
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - m_start).count();
+    record(m_key, m_label, m_signature, m_elements, seconds);
+  }
+
+ private:
+  ScopedTimer(const ScopedTimer&);
+  ScopedTimer& operator=(const ScopedTimer&);
+
+  const std::type_info& m_key;
+  const char* m_label;
+  Signature m_signature;
+  const uint64_t m_elements;
+  const std::chrono::steady_clock::time_point m_start;
+};
+
+}  // namespace profile
+}  // namespace fa
+
+#endif  // SRC_FA_PROFILE_HPP_
@@ -0,0 +1,184 @@
+// Copyright 2011 Patrick K. Notz
+#include <fa_shm.hpp>
+#include <fa_io.hpp>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <new>
+
+namespace fa {
+namespace shm {
+
+namespace {
+
+const char MAGIC[8] = { 'F', 'A', 'S', 'H', 'M', '\0', '\0', '\0' };
+const uint32_t VERSION = 1;
+
+static_assert(sizeof(Segment) == 64, "Segment must be 64 bytes");
+
+// Maps an open shared memory object, closing the descriptor
+void* map(const int fd, const size_t bytes, const int protection,
+          const std::string& name) {
+  void* base = ::mmap(0, bytes, protection, MAP_SHARED, fd, 0);
+  const int error = errno;
+  ::close(fd);
+  errno = error;
+  if (base == MAP_FAILED)
+    throw io::io_error::from_errno("cannot map shared memory ", name);
+  return base;
+}
+
+}  // namespace
+
+Allocator::Allocator(const std::string& name)
+  : m_name(name),
+    m_segment(0),
+    m_bytes(0) {}
+
+// An array still using the segment would dangle, so it is left as is
+Allocator::~Allocator() {}
+
+ScalarT* Allocator::allocate(const IndexT n) {
+  if (m_segment != 0)
+    throw io::io_error("shared memory already holds an array: ", m_name);
+  const size_t bytes = sizeof(Segment) + static_cast<size_t>(n) *
+                                             sizeof(ScalarT);
+  const int fd = ::shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0)
+    throw io::io_error::from_errno("cannot create shared memory ", m_name);
+  if (::ftruncate(fd, bytes) != 0) {
+    const int error = errno;
+    ::close(fd);
+    ::shm_unlink(m_name.c_str());
+    errno = error;
+    throw io::io_error::from_errno("cannot size shared memory ", m_name);
+  }
+  void* base;
+  try {
+    base = map(fd, bytes, PROT_READ | PROT_WRITE, m_name);
+  } catch (const io::io_error&) {
+    ::shm_unlink(m_name.c_str());
+    throw;
+  }
+
+  Segment* segment = new (base) Segment;
+  segment->version = VERSION;
+  segment->header_bytes = sizeof(Segment);
+  segment->capacity = n;
+  segment->sequence.store(0, std::memory_order_relaxed);
+  segment->retired.store(0, std::memory_order_relaxed);
+  std::memset(segment->reserved, 0, sizeof(segment->reserved));
+  // readers check the magic last written
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(segment->magic, MAGIC, sizeof(MAGIC));
+  m_segment = segment;
+  m_bytes = bytes;
+  return reinterpret_cast<ScalarT*>(static_cast<char*>(base) +
+                                    sizeof(Segment));
+}
+
+void Allocator::deallocate(ScalarT*, const IndexT) {
+  if (m_segment == 0)
+    return;
+  m_segment->retired.store(1, std::memory_order_release);
+  ::munmap(m_segment, m_bytes);
+  ::shm_unlink(m_name.c_str());
+  m_segment = 0;
+  m_bytes = 0;
+}
+
+void Allocator::begin_write() {
+  if (m_segment == 0)
+    return;
+  const uint64_t s = m_segment->sequence.load(std::memory_order_relaxed);
+  m_segment->sequence.store(s + 1, std::memory_order_relaxed);
+  // the odd version is visible before any of the writes
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void Allocator::end_write() {
+  if (m_segment == 0)
+    return;
+  const uint64_t s = m_segment->sequence.load(std::memory_order_relaxed);
+  m_segment->sequence.store(s + 1, std::memory_order_release);
+}
+
+void remove(const std::string& name) {
+  if (::shm_unlink(name.c_str()) != 0 && errno != ENOENT)
+    throw io::io_error::from_errno("cannot remove shared memory ", name);
+}
+
+Reader::Reader(const std::string& name)
+  : m_segment(0),
+    m_bytes(0) {
+  const int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    throw io::io_error::from_errno("cannot open shared memory ", name);
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    const int error = errno;
+    ::close(fd);
+    errno = error;
+    throw io::io_error::from_errno("cannot stat shared memory ", name);
+  }
+  const size_t bytes = st.st_size;
+  if (bytes < sizeof(Segment)) {
+    ::close(fd);
+    throw io::io_error("not a shared FastArray: ", name);
+  }
+  const Segment* segment =
+      static_cast<const Segment*>(map(fd, bytes, PROT_READ, name));
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (std::memcmp(segment->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      segment->version != VERSION ||
+      segment->header_bytes != sizeof(Segment) ||
+      segment->capacity > (bytes - sizeof(Segment)) / sizeof(ScalarT)) {
+    ::munmap(const_cast<Segment*>(segment), bytes);
+    throw io::io_error("not a shared FastArray: ", name);
+  }
+  m_segment = segment;
+  m_bytes = bytes;
+  m_view = FastArrayView(
+      reinterpret_cast<const ScalarT*>(
+          reinterpret_cast<const char*>(segment) + segment->header_bytes),
+      static_cast<IndexT>(segment->capacity));
+}
+
+Reader::~Reader() {
+  ::munmap(const_cast<Segment*>(m_segment), m_bytes);
+}
+
+uint64_t Reader::begin_read() const {
+  for (;;) {
+    const uint64_t s = m_segment->sequence.load(std::memory_order_acquire);
+    if ((s & 1) == 0)
+      return s;
+    ::sched_yield();
+  }
+}
+
+bool Reader::validate(const uint64_t version) const {
+  // the reads of the elements happen before the second load
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return m_segment->sequence.load(std::memory_order_relaxed) == version;
+}
+
+bool Reader::retired() const {
+  return m_segment->retired.load(std::memory_order_acquire) != 0;
+}
+
+void Reader::snapshot(FastArray* out) const {
+  out->resize(m_view.size());
+  uint64_t version;
+  do {
+    version = begin_read();
+    std::memcpy(out->data(), m_view.data(), m_view.size() * sizeof(ScalarT));
+  } while (!validate(version));
+}
+
+}  // namespace shm
+}  // namespace fa
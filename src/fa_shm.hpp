@@ -0,0 +1,144 @@
+// Copyright 2011 Patrick K. Notz
+#ifndef SRC_FA_SHM_HPP_
+#define SRC_FA_SHM_HPP_
+
+#include <FastArray.hpp>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+namespace fa {
+namespace shm {
+
+//
+// FastArrays in POSIX shared memory, for cooperating processes on one
+// node. The writing process gives its array a shm::Allocator, which
+// creates the named shared memory object when the array allocates;
+// other processes attach a Reader by the same name and read the
+// elements in place.
+//
+// Consistency is a seqlock: the writer brackets each update with
+// begin_write()/end_write() (or a WriteScope), which only bumps a
+// version number, so it never waits for readers. A reader takes the
+// version before reading and validates it afterwards, retrying if a
+// write overlapped; snapshot() does this for a copy.
+//
+//   // solver                         // analysis
+//   fa::shm::Allocator shared("/p");  fa::shm::Reader r("/p");
+//   fa::FastArray p(n, &shared);      uint64_t v;
+//   {                                 do {
+//     fa::shm::WriteScope w(shared);    v = r.begin_read();
+//     p = p + dt * dp;                  q = r.view() * scale;
+//   }                                 } while (!r.validate(v));
+//
+// Segments hold a 64-byte header and then the elements, which are
+// 64-byte aligned. Errors throw fa::io::io_error.
+//
+
+struct Segment {
+  char magic[8];                   // "FASHM\0\0\0"
+  uint32_t version;                // of this layout
+  uint32_t header_bytes;           // offset of the elements
+  uint64_t capacity;               // elements
+  std::atomic<uint64_t> sequence;  // odd while a write is in progress
+  std::atomic<uint32_t> retired;   // set when the writer frees the array
+  uint32_t reserved[7];
+};
+
+//
+// Allocator - allocates one FastArray at a time as the shared memory
+// object name (e.g. "/solver-pressure"), which must not exist yet,
+// and unlinks it when the array frees it. An array that grows is moved
+// to a new object of the same name; readers attached to the old one
+// see it retired and should attach again.
+//
+class Allocator : public fa::Allocator {
+ public:
+  explicit Allocator(const std::string& name);
+  ~Allocator();
+
+  ScalarT* allocate(const IndexT n);
+  void deallocate(ScalarT* p, const IndexT n);
+
+  const std::string& name() const {
+    return m_name;
+  }
+
+  // Seqlock writer side; writes are not nested
+  void begin_write();
+  void end_write();
+
+ private:
+  Allocator(const Allocator&);
+  Allocator& operator=(const Allocator&);
+
+  const std::string m_name;
+  Segment* m_segment;
+  size_t m_bytes;
+};
+
+// Removes the shared memory object name, if any, such as one left by
+// a writer that crashed
+void remove(const std::string& name);
+
+// Brackets an update of an array of a shm::Allocator
+class WriteScope {
+ public:
+  explicit WriteScope(Allocator& allocator) : m_allocator(allocator) {
+    m_allocator.begin_write();
+  }
+  ~WriteScope() {
+    m_allocator.end_write();
+  }
+
+ private:
+  WriteScope(const WriteScope&);
+  WriteScope& operator=(const WriteScope&);
+
+  Allocator& m_allocator;
+};
+
+//
+// Reader - a read-only attachment to a shared array
+//
+class Reader {
+ public:
+  explicit Reader(const std::string& name);
+  ~Reader();
+
+  // All capacity() elements, in place
+  const FastArrayView& view() const {
+    return m_view;
+  }
+
+  IndexT capacity() const {
+    return m_view.size();
+  }
+
+  // Waits out a write in progress and returns the version to validate
+  uint64_t begin_read() const;
+
+  // True if no write began since begin_read() returned version, so
+  // what was read in between is consistent
+  bool validate(const uint64_t version) const;
+
+  // True once the writer has freed or moved the array
+  bool retired() const;
+
+  // Copies a consistent snapshot into out, retrying while writes
+  // overlap the copy
+  void snapshot(FastArray* out) const;
+
+ private:
+  Reader(const Reader&);
+  Reader& operator=(const Reader&);
+
+  const Segment* m_segment;
+  size_t m_bytes;
+  FastArrayView m_view;
+};
+
+}  // namespace shm
+}  // namespace fa
+
+#endif  // SRC_FA_SHM_HPP_
@@ -0,0 +1,228 @@
+// Unit tests for the optional instrumentation layers; this file is
+// compiled with -DFA_PERF_COUNTERS -DFA_PROFILE -DFA_ALLOCATION_COUNTERS
+// (see CMakeLists.txt)
+#include <gtest/gtest.h>
+#include <FastArray.hpp>
+#include <fa_block.hpp>
+#include <fa_cow.hpp>
+#include <fa_parallel.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+const fa::IndexT SIZE = 100000;
+
+namespace {
+
+const fa::perf::Record* find_record(
+    const std::vector<fa::perf::Record>& records, const std::string& op) {
+  for(size_t k=0; k < records.size(); ++k) {
+    if(records[k].expression.find(op) == 0)
+      return &records[k];
+  }
+  return 0;
+}
+
+}  // namespace
+
+TEST(PerfCounters, records_per_expression_type)
+{
+  fa::perf::reset();
+  fa::FastArray fa(SIZE, 1.0);
+  fa::FastArray fb(SIZE, 2.0);
+  fa::FastArray fc(SIZE);
+  for(int k=0; k < 3; ++k)
+    fc = fa * fb + 1.0;
+  fc += exp(fa);
+
+  const std::vector<fa::perf::Record> records = fa::perf::records();
+  ASSERT_EQ(2u, records.size());
+
+  const fa::perf::Record* assign = find_record(records, "fa::assign_op");
+  ASSERT_TRUE(assign != 0);
+  ASSERT_EQ(3u, assign->calls);
+  ASSERT_EQ(3u * SIZE, assign->elements);
+  ASSERT_NE(std::string::npos, assign->expression.find("fa::addition"));
+
+  const fa::perf::Record* plus = find_record(records, "fa::plus_assign_op");
+  ASSERT_TRUE(plus != 0);
+  ASSERT_EQ(1u, plus->calls);
+  ASSERT_NE(std::string::npos, plus->expression.find("fa::math_exp"));
+}
+
+TEST(PerfCounters, counters)
+{
+  fa::perf::CounterGroup& counters = fa::perf::thread_counters();
+  fa::perf::Sample sample;
+  counters.start();
+  fa::FastArray fa(SIZE, 1.0);
+  fa::FastArray fb(SIZE);
+  fb = sqrt(fa);
+  counters.stop(&sample);
+
+  for(int c=0; c < fa::perf::NUM_COUNTERS; ++c) {
+    const fa::perf::Counter counter = static_cast<fa::perf::Counter>(c);
+    ASSERT_EQ(counters.available(counter), sample.valid[c])
+        << fa::perf::counter_name(counter);
+  }
+  if(counters.available(fa::perf::INSTRUCTIONS)) {
+    ASSERT_GT(sample.value[fa::perf::INSTRUCTIONS], 0u);
+  }
+}
+
+TEST(PerfCounters, parallel_evaluation)
+{
+#if defined(_OPENMP)
+  const int threads = omp_get_max_threads();
+  omp_set_num_threads(3);
+#endif
+  fa::perf::reset();
+  fa::FastArray fa(SIZE, 1.0);
+  fa::FastArray fb(SIZE);
+  fa::parallel(fb) = sqrt(fa);
+#if defined(_OPENMP)
+  omp_set_num_threads(threads);
+#endif
+
+  // one call over every element, counted on every thread
+  const std::vector<fa::perf::Record> records = fa::perf::records();
+  ASSERT_EQ(1u, records.size());
+  ASSERT_EQ(1u, records[0].calls);
+  ASSERT_EQ(static_cast<uint64_t>(SIZE), records[0].elements);
+  fa::perf::CounterGroup& counters = fa::perf::thread_counters();
+  for(int c=0; c < fa::perf::NUM_COUNTERS; ++c) {
+    const fa::perf::Counter counter = static_cast<fa::perf::Counter>(c);
+    if(!counters.available(counter)) {
+      ASSERT_FALSE(records[0].valid[c]) << fa::perf::counter_name(counter);
+    }
+  }
+}
+
+TEST(PerfCounters, block_and_dump)
+{
+  fa::perf::reset();
+  fa::FastArray fa(SIZE, 1.0);
+  fa::FastArray fb(SIZE);
+  fa::DeferredBlock block;
+  block.assign(fb, fa + 1.0).assign(fa, fb * 2.0);
+  block.run();
+
+  const std::vector<fa::perf::Record> records = fa::perf::records();
+  ASSERT_EQ(1u, records.size());
+  ASSERT_EQ("fa::DeferredBlock", records[0].expression);
+
+  std::ostringstream os;
+  fa::perf::dump(os);
+  ASSERT_NE(std::string::npos, os.str().find("fa::DeferredBlock"));
+  ASSERT_NE(std::string::npos, os.str().find("calls 1"));
+  fa::perf::reset();
+}
+
+TEST(Profile, entries_keyed_on_expression)
+{
+  fa::profile::reset();
+  fa::FastArray fa(SIZE, 3.0);
+  fa::FastArray fb(SIZE, 5.0);
+  fa::FastArray fc(SIZE, 7.0);
+  fa::FastArray fd(SIZE, 11.0);
+  fa::FastArray ff(SIZE);
+  for(int k=0; k < 2; ++k)
+    ff = log10(exp(fa) + cos(fb) * pow(fc, 2.5) / (-fd + 13.0));
+  ff += fa::term<fa::FastArray>(fa);
+  fa::tie(fc, fd) = std::make_tuple(fa + fb, fa * 2.0);
+
+  const std::vector<fa::profile::Entry> entries = fa::profile::entries();
+  ASSERT_EQ(3u, entries.size());
+  for(size_t k=0; k < entries.size(); ++k) {
+    const fa::profile::Entry& e = entries[k];
+    if(e.label == "=") {
+      ASSERT_EQ("log10(exp(A)+cos(B)*pow(C,s)/(-D+s))", e.signature);
+      ASSERT_EQ(2u, e.calls);
+      ASSERT_EQ(2u * SIZE, e.elements);
+      ASSERT_GT(e.seconds, 0.0);
+      ASSERT_NE(std::string::npos, e.type.find("fa::math_log10"));
+    } else if(e.label == "+=") {
+      ASSERT_EQ("A", e.signature);
+    } else {
+      ASSERT_EQ("tie=", e.label);
+      ASSERT_EQ("(A+B,C*s)", e.signature);
+    }
+  }
+  // sorted by decreasing time
+  for(size_t k=1; k < entries.size(); ++k)
+    ASSERT_GE(entries[k - 1].seconds, entries[k].seconds);
+
+  std::ostringstream json, csv;
+  fa::profile::write_json(json);
+  fa::profile::write_csv(csv);
+  ASSERT_NE(std::string::npos,
+            json.str().find("\"signature\": \"(A+B,C*s)\""));
+  ASSERT_EQ(0u, csv.str().find("label,signature,calls,"));
+  ASSERT_NE(std::string::npos, csv.str().find("\"+=\",\"A\",1,"));
+  fa::profile::reset();
+}
+
+TEST(AllocationCounters, allocations_copies_and_peak)
+{
+  fa::alloc::reset();
+  const uint64_t live = fa::alloc::counts().bytes_live;
+  const uint64_t bytes = SIZE * sizeof(fa::ScalarT);
+  {
+    fa::FastArray fa(SIZE, 1.0);
+    fa::FastArray fb(fa);            // copy
+    fa::FastArray fc;
+    fc = fa;                         // copy, allocates
+    fc = fb;                         // copy, reuses the buffer
+    fc.resize(SIZE / 2);             // shrinks in place
+    fc.resize(2 * SIZE);             // reallocates
+    fc = fa + fb;                    // expression, no copy
+
+    const fa::alloc::Counts c = fa::alloc::counts();
+    ASSERT_EQ(4u, c.allocations);
+    ASSERT_EQ(1u, c.reallocations);
+    ASSERT_EQ(1u, c.deallocations);
+    ASSERT_EQ(3u, c.copies);
+    ASSERT_EQ(live + 4 * bytes, c.bytes_live);
+    ASSERT_EQ(live + 4 * bytes, c.peak_bytes);
+  }
+  fa::alloc::Counts c = fa::alloc::counts();
+  ASSERT_EQ(4u, c.deallocations);
+  ASSERT_EQ(live, c.bytes_live);
+  ASSERT_EQ(live + 4 * bytes, c.peak_bytes);
+
+  std::ostringstream os;
+  fa::alloc::write(os, c);
+  ASSERT_EQ(0u, os.str().find("allocations 4 reallocations 1"));
+
+  fa::alloc::reset();
+  c = fa::alloc::counts();
+  ASSERT_EQ(0u, c.allocations);
+  ASSERT_EQ(0u, c.copies);
+  ASSERT_EQ(live, c.peak_bytes);
+}
+
+TEST(AllocationCounters, copy_on_write)
+{
+  fa::alloc::reset();
+  const uint64_t live = fa::alloc::counts().bytes_live;
+  const uint64_t bytes = SIZE * sizeof(fa::ScalarT);
+  {
+    fa::FastArray fa(SIZE, fa::cow::allocator());
+    fa = 1.0;
+    fa::FastArray fb(fa);            // shares, copies nothing
+    fa::FastArray fc(fb);            // shares, copies nothing
+    ASSERT_EQ(1u, fa::alloc::counts().allocations);
+    ASSERT_EQ(0u, fa::alloc::counts().copies);
+    ASSERT_EQ(live + bytes, fa::alloc::counts().bytes_live);
+    fb[0] = 2.0;                     // fb copies into its own buffer
+
+    const fa::alloc::Counts c = fa::alloc::counts();
+    ASSERT_EQ(2u, c.allocations);
+    ASSERT_EQ(0u, c.deallocations);
+    ASSERT_EQ(1u, c.copies);
+    ASSERT_EQ(live + 2 * bytes, c.bytes_live);
+  }
+  const fa::alloc::Counts c = fa::alloc::counts();
+  ASSERT_EQ(2u, c.deallocations);
+  ASSERT_EQ(live, c.bytes_live);
+}
@@ -1,5 +1,27 @@
 #include <gtest/gtest.h>
 #include <FastArray.hpp>
+#include <fa_arena.hpp>
+#include <fa_block.hpp>
+#include <fa_codec.hpp>
+#include <fa_cow.hpp>
+#include <fa_io.hpp>
+#include <fa_npy.hpp>
+#include <fa_numa.hpp>
+#include <fa_ooc.hpp>
+#include <fa_parallel.hpp>
+#include <fa_pool.hpp>
+#include <fa_shm.hpp>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <vector>
 
 const fa::IndexT SIZE = 100000;
 
@@ -51,6 +73,19 @@ TEST(FastArray, ctor_size_val)
   }
 }
 
+TEST(FastArray, ctor_size_int_val)
+{
+  // a literal 0 is also a null Allocator*, so this must not be ambiguous
+  const fa::IndexT size = SIZE;
+  fa::FastArray fb(size, 0);
+  ASSERT_EQ(size, fb.size());
+  for(fa::IndexT i=0; i < size; ++i) {
+    ASSERT_EQ(0.0, fb[i]);
+  }
+  fa::FastArray fc(size, 2);
+  ASSERT_EQ(2.0, fc[size - 1]);
+}
+
 TEST(FastArray, set_all)
 {
   const fa::IndexT size = SIZE;
@@ -504,3 +539,1260 @@ TEST(FastArray, kitchen_sink)
   }
 }
 
+
+struct axpy_kernel {
+  double operator()(double a, double x, double y) const {
+    return a * x + y;
+  }
+};
+
+TEST(FastArray, map_unary)
+{
+  const fa::IndexT size = SIZE;
+  const fa::ScalarT a = 3;
+
+  fa::FastArray fa(size, a);
+  fa::FastArray fb(size);
+  fb = map([](double x) { return x * x + 1; }, fa);
+
+  for(fa::IndexT i=0; i < size; ++i) {
+    ASSERT_DOUBLE_EQ(a * a + 1, fb[i]);
+  }
+}
+
+TEST(FastArray, map_ternary_functor)
+{
+  const fa::IndexT size = SIZE;
+  const fa::ScalarT a = 3;
+  const fa::ScalarT x = 5;
+  const fa::ScalarT y = 7;
+
+  fa::FastArray fx(size, x);
+  fa::FastArray fy(size, y);
+  fa::FastArray fz(size);
+  fz = map(axpy_kernel(), a, fx, fy);
+
+  for(fa::IndexT i=0; i < size; ++i) {
+    ASSERT_DOUBLE_EQ(a * x + y, fz[i]);
+  }
+}
+
+TEST(FastArray, map_in_expression)
+{
+  const fa::IndexT size = SIZE;
+  const fa::ScalarT a = 3;
+  const fa::ScalarT b = 5;
+  const fa::ScalarT c = 7;
+
+  fa::FastArray fa(size, a);
+  fa::FastArray fb(size, b);
+  fa::FastArray fc(size, c);
+  fa::FastArray fd(size);
+  fd = c * map([](double x, double y) { return std::max(x, y); },
+               fa + fb, fc) - fa;
+
+  const fa::ScalarT d = c * std::max(a + b, c) - a;
+  for(fa::IndexT i=0; i < size; ++i) {
+    ASSERT_DOUBLE_EQ(d, fd[i]);
+  }
+}
+
+TEST(FastArray, tie_multi_output)
+{
+  const fa::IndexT size = SIZE;
+  const fa::ScalarT a = 3;
+  const fa::ScalarT b = 5;
+
+  fa::FastArray fa(size, a);
+  fa::FastArray fb(size, b);
+  fa::FastArray fu(size);
+  fa::FastArray fv(size);
+  fa::FastArray fw(size);
+  tie(fu, fv, fw) = std::make_tuple(fa + fb, sqrt(fa * fb), fa - fb * 2.0);
+
+  for(fa::IndexT i=0; i < size; ++i) {
+    ASSERT_DOUBLE_EQ(a + b, fu[i]);
+    ASSERT_DOUBLE_EQ(std::sqrt(a * b), fv[i]);
+    ASSERT_DOUBLE_EQ(a - b * 2.0, fw[i]);
+  }
+}
+
+TEST(FastArray, tie_in_place)
+{
+  const fa::IndexT size = SIZE;
+  const fa::ScalarT a = 3;
+  const fa::ScalarT b = 5;
+
+  // each output only reads its own element, so updating
+  // inputs in place is well defined
+  fa::FastArray fa(size, a);
+  fa::FastArray fb(size, b);
+  fa::tie(fa, fb) = std::make_tuple(fa * fb, fa + fb);
+
+  for(fa::IndexT i=0; i < size; ++i) {
+    ASSERT_DOUBLE_EQ(a * b, fa[i]);
+    ASSERT_DOUBLE_EQ(a * b + b, fb[i]);
+  }
+}
+
+TEST(FastArray, tie_size_mismatch)
+{
+  fa::FastArray fa(SIZE, 1.0);
+  fa::FastArray big(SIZE);
+  fa::FastArray small(SIZE / 2);
+  ASSERT_THROW(fa::tie(big, small) = std::make_tuple(fa + fa, fa - fa),
+               std::length_error);
+  ASSERT_THROW(fa::tie(small, big) = std::make_tuple(fa + fa, fa - fa),
+               std::length_error);
+}
+
+TEST(DeferredBlock, matches_eager_evaluation)
+{
+  // not a multiple of the tile size
+  const fa::IndexT size = SIZE + 17;
+  fa::FastArray fa(size);
+  fa::FastArray fb(size);
+  for(fa::IndexT i=0; i < size; ++i) {
+    fa[i] = 1.0 + i % 7;
+    fb[i] = 2.0 + i % 5;
+  }
+  fa::FastArray fu(size), fv(size), fw(size);
+  fa::FastArray eu(size), ev(size), ew(size), ea(fa);
+
+  // later statements read earlier results, and the last one
+  // overwrites an operand of the first
+  eu = fa * fb + 1.0;
+  ev = sqrt(eu) - fb / (eu + 2.0);
+  ew = ev * eu + fa;
+  ea = ew - ea;
+
+  fa::DeferredBlock block(256);
+  block.assign(fu, fa * fb + 1.0)
+       .assign(fv, sqrt(fu) - fb / (fu + 2.0))
+       .assign(fw, fv * fu + fa)
+       .assign(fa, fw - fa);
+  ASSERT_EQ(4u, block.num_statements());
+  ASSERT_TRUE(block.tiled());
+  block.run();
+
+  for(fa::IndexT i=0; i < size; ++i) {
+    ASSERT_DOUBLE_EQ(eu[i], fu[i]);
+    ASSERT_DOUBLE_EQ(ev[i], fv[i]);
+    ASSERT_DOUBLE_EQ(ew[i], fw[i]);
+    ASSERT_DOUBLE_EQ(ea[i], fa[i]);
+  }
+}
+
+TEST(DeferredBlock, rerun)
+{
+  const fa::IndexT size = SIZE;
+  fa::FastArray fa(size, 1.0);
+  fa::FastArray fb(size, 0.0);
+
+  fa::DeferredBlock block;
+  block.assign(fb, fb + fa);
+  block.assign(fa, fa * 2.0);
+  for(int step=0; step < 3; ++step)
+    block.run();
+
+  // fb = 1 + 2 + 4, fa = 8
+  for(fa::IndexT i=0; i < size; ++i) {
+    ASSERT_DOUBLE_EQ(7.0, fb[i]);
+    ASSERT_DOUBLE_EQ(8.0, fa[i]);
+  }
+}
+
+TEST(DeferredBlock, size_mismatch)
+{
+  fa::FastArray fa(SIZE, 1.0);
+  fa::FastArray fb(SIZE / 2);
+
+  fa::DeferredBlock block;
+  block.assign(fa, fa + 1.0);
+  ASSERT_THROW(block.assign(fb, fa * 2.0), std::length_error);
+
+  // a destination resized after it was recorded
+  fa::FastArray fc(SIZE);
+  block.assign(fc, fa * 2.0);
+  fc.resize(SIZE / 2);
+  ASSERT_THROW(block.run(), std::length_error);
+  fc.resize(SIZE);
+  block.run();
+  ASSERT_EQ(4.0, fc[SIZE - 1]);
+}
+
+TEST(DeferredBlock, bad_tile_size)
+{
+  ASSERT_THROW(fa::DeferredBlock block(0), std::invalid_argument);
+  ASSERT_THROW(fa::DeferredBlock block(-1), std::invalid_argument);
+}
+
+TEST(DeferredBlock, shifted_view)
+{
+  const fa::IndexT size = SIZE + 17;
+  fa::FastArray fa(size);
+  for(fa::IndexT i=0; i < size; ++i)
+    fa[i] = 1.0 + i % 7;
+  // the view reads one element past the end of fu, into its capacity
+  fa::FastArray fu(size + 1, -1.0);
+  fu.resize(size);
+  fa::FastArray fv(size);
+
+  // fv reads fu one element ahead, across every tile boundary
+  fa::DeferredBlock block(256);
+  block.assign(fu, fa * 2.0)
+       .assign(fv, fa::FastArrayView(fu.data() + 1, size) + 1.0);
+  ASSERT_FALSE(block.tiled());
+  block.run();
+
+  for(fa::IndexT i=0; i + 1 < size; ++i)
+    ASSERT_EQ(2.0 * fa[i + 1] + 1.0, fv[i]);
+  ASSERT_EQ(0.0, fv[size - 1]);
+}
+
+TEST(FastArray, aliases)
+{
+  const fa::IndexT size = SIZE;
+  fa::FastArray fa(size, 1.0);
+  fa::FastArray fb(size, 2.0);
+  fa::FastArray fc(size);
+  const fa::ScalarT* c_begin = fc.data();
+  const fa::ScalarT* c_end = fc.data() + size;
+
+  ASSERT_FALSE(fa::term<fa::ScalarT>(3.0).aliases(c_begin, c_end));
+  ASSERT_FALSE(fa::term<fa::FastArray>(fa).aliases(c_begin, c_end));
+  ASSERT_TRUE(fa::term<fa::FastArray>(fc).aliases(c_begin, c_end));
+  ASSERT_TRUE(fa::term<fa::FastArray>(fc).aliases(c_end - 1, c_end));
+  ASSERT_FALSE(fa::term<fa::FastArray>(fc).aliases(c_end, c_end + 1));
+  ASSERT_FALSE((fa + exp(fb) * 2.0).aliases(c_begin, c_end));
+  ASSERT_TRUE((fa + exp(fc) * 2.0).aliases(c_begin, c_end));
+  ASSERT_TRUE(map([](double x, double y) { return x + y; }, fa, -fc)
+              .aliases(c_begin, c_end));
+}
+
+TEST(FastArray, aliased_assignment)
+{
+  const fa::IndexT size = SIZE;
+  const fa::ScalarT a = 3;
+  const fa::ScalarT b = 5;
+
+  fa::FastArray fa(size, a);
+  fa::FastArray fb(size, b);
+  fa = fa * fb + fa;
+  fb -= fb * fa;
+
+  const fa::ScalarT c = a * b + a;
+  for(fa::IndexT i=0; i < size; ++i) {
+    ASSERT_DOUBLE_EQ(c, fa[i]);
+    ASSERT_DOUBLE_EQ(b - b * c, fb[i]);
+  }
+}
+
+TEST(FastArray, streaming)
+{
+  // odd size and offset start exercise the unaligned head and tail
+  const fa::IndexT size = SIZE + 3;
+  const fa::ScalarT a = 3;
+  const fa::ScalarT b = 5;
+
+  fa::FastArray fa(size, a);
+  fa::FastArray fb(size, b);
+  fa::FastArray fc(size, 0.0);
+  fa::streaming(fc) = fa * fb + 1.0;
+  for(fa::IndexT i=0; i < size; ++i) {
+    ASSERT_DOUBLE_EQ(a * b + 1.0, fc[i]);
+  }
+
+  fc.stream(fa::term<fa::FastArray>(fa), 1, size - 1);
+  ASSERT_DOUBLE_EQ(a * b + 1.0, fc[0]);
+  ASSERT_DOUBLE_EQ(a * b + 1.0, fc[size - 1]);
+  for(fa::IndexT i=1; i < size - 1; ++i) {
+    ASSERT_DOUBLE_EQ(a, fc[i]);
+  }
+
+  // aliased operands fall back to the regular loop
+  fa::streaming(fa) = fa * fb;
+  for(fa::IndexT i=0; i < size; ++i) {
+    ASSERT_DOUBLE_EQ(a * b, fa[i]);
+  }
+}
+
+TEST(FastArray, streaming_threshold)
+{
+  const size_t original = fa::streaming_threshold();
+  ASSERT_GT(original, 0u);
+
+  const fa::IndexT size = SIZE;
+  fa::FastArray fa(size, 2.0);
+  fa::FastArray fb(size);
+  fa::set_streaming_threshold(0);
+  fb = sqrt(fa) * fa;
+  fa::set_streaming_threshold(original);
+
+  for(fa::IndexT i=0; i < size; ++i) {
+    ASSERT_DOUBLE_EQ(std::sqrt(2.0) * 2.0, fb[i]);
+  }
+}
+
+TEST(FastArray, signature)
+{
+  fa::FastArray fa(10), fb(10), fc(10), fd(10);
+  ASSERT_EQ("A", fa::signature(fa));
+  ASSERT_EQ("A+B*C", fa::signature(fa + fb * fc));
+  ASSERT_EQ("(A+B)*C", fa::signature((fa + fb) * fc));
+  ASSERT_EQ("A-(B-C)", fa::signature(fa - (fb - fc)));
+  ASSERT_EQ("A-B-C", fa::signature(fa - fb - fc));
+  ASSERT_EQ("-(A+s)", fa::signature(-(fa + 2.0)));
+  ASSERT_EQ("atan2(A,-B)", fa::signature(atan2(fa, -fb)));
+  ASSERT_EQ("map(A,s,sqrt(B))",
+            fa::signature(map([](double x, double y, double z) {
+                                return x + y + z;
+                              }, fa, 2.0, sqrt(fb))));
+  ASSERT_EQ("log10(exp(A)+cos(B)*pow(C,s)/(-D+s))",
+            fa::signature(log10(exp(fa) + cos(fb) * pow(fc,2.5) /
+                                (-fd + 13.0))));
+}
+
+TEST(FastArray, expression_cost)
+{
+  fa::FastArray fa(10), fb(10), fc(10), fd(10);
+  const fa::cost c1 = fa::expression_cost(fa + fb * 2.0);
+  ASSERT_EQ(2, c1.arrays);
+  ASSERT_EQ(2, c1.flops);
+  const fa::cost c2 = fa::expression_cost(fa + fb * fc / (fd + 13.0));
+  ASSERT_EQ(4, c2.arrays);
+  ASSERT_EQ(4, c2.flops);
+  const fa::cost c3 = fa::expression_cost(sqrt(fa * fa));
+  ASSERT_EQ(2, c3.arrays);
+  ASSERT_EQ(2, c3.flops);
+}
+
+TEST(Parallel, partition)
+{
+  const fa::IndexT line = 64 / sizeof(fa::ScalarT);
+  const fa::IndexT sizes[] = { 0, 1, 7, 8, 9, 100, SIZE + 3 };
+  for(size_t s=0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    const fa::IndexT n = sizes[s];
+    for(int parts=1; parts <= 5; ++parts) {
+      fa::IndexT next = 0;
+      for(int k=0; k < parts; ++k) {
+        const fa::range r = fa::partition(n, parts, k);
+        ASSERT_EQ(next, r.begin);
+        ASSERT_LE(r.begin, r.end);
+        if(r.end < n) {
+          ASSERT_EQ(0, r.end % line);
+        }
+        next = r.end;
+      }
+      ASSERT_EQ(n, next);
+    }
+  }
+  // lines are spread evenly
+  const fa::range first = fa::partition(10 * line, 4, 0);
+  const fa::range last = fa::partition(10 * line, 4, 3);
+  ASSERT_EQ(3 * line, first.end - first.begin);
+  ASSERT_EQ(2 * line, last.end - last.begin);
+}
+
+TEST(Parallel, assignment)
+{
+  const fa::IndexT size = SIZE + 3;
+  const fa::ScalarT a = 3;
+  const fa::ScalarT b = 5;
+  fa::FastArray fa(size, a);
+  fa::FastArray fb(size, b);
+  fa::FastArray fc(size, 0.0);
+
+  fa::parallel(fc) = fa * fb + 1.0;
+  for(fa::IndexT i=0; i < size; ++i)
+    ASSERT_DOUBLE_EQ(a * b + 1.0, fc[i]);
+
+  fa::parallel(fc).evaluate<fa::plus_assign_op>(fa::term<fa::FastArray>(fa));
+  for(fa::IndexT i=0; i < size; ++i)
+    ASSERT_DOUBLE_EQ(a * b + 1.0 + a, fc[i]);
+
+  fa::parallel(fc).stream(fa - fb);
+  for(fa::IndexT i=0; i < size; ++i)
+    ASSERT_DOUBLE_EQ(a - b, fc[i]);
+
+  // aliased
+  fa::parallel(fa).stream(fa * fb);
+  for(fa::IndexT i=0; i < size; ++i)
+    ASSERT_DOUBLE_EQ(a * b, fa[i]);
+}
+
+namespace {
+
+// Unique temporary file name, removed when the test ends
+struct TempFile {
+  TempFile() {
+    char name[] = "/tmp/fa-unit-test-XXXXXX";
+    const int fd = mkstemp(name);
+    close(fd);
+    path = name;
+  }
+  ~TempFile() {
+    std::remove(path.c_str());
+  }
+  std::string path;
+};
+
+}  // namespace
+
+TEST(FastArrayView, expression_operand)
+{
+  const fa::IndexT size = 100;
+  fa::FastArray fa(size, 3.0);
+  fa::FastArray fb(size, 5.0);
+  const fa::FastArrayView va(fa);
+  ASSERT_EQ(size, va.size());
+  ASSERT_EQ("A+B*s", fa::signature(va + fb * 2.0));
+
+  fa::FastArray fc(size);
+  fc = va + fb * 2.0;
+  for(fa::IndexT i=0; i < size; ++i)
+    ASSERT_DOUBLE_EQ(13.0, fc[i]);
+
+  ASSERT_TRUE(fa::term<fa::FastArrayView>(va).aliases(
+      fa.data() + 10, fa.data() + 11));
+  ASSERT_FALSE(fa::term<fa::FastArrayView>(va).aliases(
+      fc.data(), fc.data() + size));
+  // aliased assignment through a view
+  fa = fb - va;
+  for(fa::IndexT i=0; i < size; ++i)
+    ASSERT_DOUBLE_EQ(2.0, fa[i]);
+}
+
+TEST(IO, save_load_and_map)
+{
+  const fa::IndexT size = SIZE + 3;
+  fa::FastArray fa(size);
+  for(fa::IndexT i=0; i < size; ++i)
+    fa[i] = 0.5 * i - 7;
+  TempFile file;
+  fa::io::save(file.path, fa);
+
+  const fa::io::Header h = fa::io::read_header(file.path);
+  ASSERT_EQ(static_cast<uint64_t>(size), h.size);
+  ASSERT_EQ(sizeof(fa::ScalarT), h.scalar_bytes);
+  ASSERT_EQ(0u, h.header_bytes % h.alignment);
+
+  fa::FastArray fb;
+  fa::io::load(file.path, &fb);
+  ASSERT_EQ(size, fb.size());
+  for(fa::IndexT i=0; i < size; ++i)
+    ASSERT_EQ(fa[i], fb[i]);
+
+  const fa::io::MappedArray mapped(file.path);
+  ASSERT_EQ(size, mapped.size());
+  ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(mapped.view().data()) % 64);
+  ASSERT_TRUE(mapped.verify());
+  fa::FastArray fc(size);
+  fc = mapped.view() * 2.0 - fa;
+  for(fa::IndexT i=0; i < size; ++i)
+    ASSERT_DOUBLE_EQ(fa[i], fc[i]);
+
+  // empty arrays round-trip
+  fa::FastArray empty;
+  fa::io::save(file.path, empty);
+  fa::io::load(file.path, &fb);
+  ASSERT_EQ(0, fb.size());
+}
+
+TEST(IO, detects_corruption)
+{
+  fa::FastArray fa(1000, 1.0);
+  TempFile file;
+  fa::io::save(file.path, fa);
+  {
+    // flip one bit of the last element
+    FILE* f = std::fopen(file.path.c_str(), "r+b");
+    std::fseek(f, -1, SEEK_END);
+    const int c = std::fgetc(f);
+    std::fseek(f, -1, SEEK_END);
+    std::fputc(c ^ 1, f);
+    std::fclose(f);
+  }
+  fa::FastArray fb;
+  ASSERT_THROW(fa::io::load(file.path, &fb), fa::io::io_error);
+  ASSERT_FALSE(fa::io::MappedArray(file.path).verify());
+
+  {
+    FILE* f = std::fopen(file.path.c_str(), "wb");
+    std::fputs("not an array file, but long enough to hold a header.......",
+               f);
+    std::fclose(f);
+  }
+  ASSERT_THROW(fa::io::load(file.path, &fb), fa::io::io_error);
+  ASSERT_THROW(fa::io::MappedArray mapped(file.path), fa::io::io_error);
+  ASSERT_THROW(fa::io::load("/nonexistent/fa.bin", &fb), fa::io::io_error);
+
+  // a writer that is not closed leaves no file behind
+  {
+    fa::io::Writer writer(file.path);
+    writer.write(fa);
+  }
+  ASSERT_NE(0, access(file.path.c_str(), F_OK));
+}
+
+namespace {
+
+void write_bytes(const std::string& path, const std::string& bytes) {
+  FILE* f = std::fopen(path.c_str(), "wb");
+  std::fwrite(bytes.data(), 1, bytes.size(), f);
+  std::fclose(f);
+}
+
+// .npy version 1.0 image with the given header dictionary
+std::string npy_image(const std::string& dict, const std::string& data) {
+  std::string header = dict;
+  while((10 + header.size() + 1) % 64 != 0)
+    header.push_back(' ');
+  header.push_back('\n');
+  std::string image("\x93NUMPY\x01\x00", 8);
+  image.push_back(static_cast<char>(header.size() & 0xff));
+  image.push_back(static_cast<char>(header.size() >> 8));
+  return image.append(header).append(data);
+}
+
+}  // namespace
+
+TEST(Npy, save_load_and_map)
+{
+  const fa::IndexT size = 1000;
+  fa::FastArray fa(size);
+  for(fa::IndexT i=0; i < size; ++i)
+    fa[i] = 0.25 * i - 3;
+  TempFile file;
+  fa::npy::save(file.path, fa);
+
+  const fa::npy::Info info = fa::npy::read_info(file.path);
+  ASSERT_EQ("<f8", info.descr);
+  ASSERT_FALSE(info.fortran_order);
+  ASSERT_EQ(1u, info.shape.size());
+  ASSERT_EQ(static_cast<uint64_t>(size), info.shape[0]);
+  ASSERT_EQ(0u, info.data_offset % 64);
+
+  fa::FastArray fb;
+  fa::npy::load(file.path, &fb);
+  ASSERT_EQ(size, fb.size());
+  for(fa::IndexT i=0; i < size; ++i)
+    ASSERT_EQ(fa[i], fb[i]);
+
+  const fa::npy::MappedArray mapped(file.path);
+  ASSERT_EQ(size, mapped.view().size());
+  fb = mapped.view() + fa;
+  for(fa::IndexT i=0; i < size; ++i)
+    ASSERT_DOUBLE_EQ(2 * fa[i], fb[i]);
+}
+
+TEST(Npy, chunked_writer)
+{
+  fa::FastArray chunk(100);
+  TempFile file;
+  {
+    fa::npy::Writer writer(file.path);
+    for(int k=0; k < 5; ++k) {
+      chunk.set_all(k);
+      writer.write(chunk);
+    }
+    ASSERT_EQ(500u, writer.size());
+    writer.close();
+  }
+  fa::FastArray fa;
+  fa::npy::load(file.path, &fa);
+  ASSERT_EQ(500, fa.size());
+  for(fa::IndexT i=0; i < fa.size(); ++i)
+    ASSERT_EQ(i / 100, fa[i]);
+}
+
+TEST(Npy, dtypes_byte_order_and_shape)
+{
+  TempFile file;
+  // big-endian float32 2x2 in Fortran order
+  const std::string be_f4("\x3f\x80\x00\x00\x40\x00\x00\x00"
+                          "\xc0\x40\x00\x00\x00\x00\x00\x00", 16);
+  write_bytes(file.path, npy_image(
+      "{'descr': '>f4', 'fortran_order': True, 'shape': (2, 2), }", be_f4));
+  const fa::npy::Info info = fa::npy::read_info(file.path);
+  ASSERT_TRUE(info.fortran_order);
+  ASSERT_EQ(2u, info.shape.size());
+  ASSERT_EQ(4u, info.size);
+  ASSERT_FALSE(fa::npy::is_native(info));
+  fa::FastArray fa;
+  fa::npy::load(file.path, &fa);
+  ASSERT_EQ(4, fa.size());
+  ASSERT_EQ(1.0, fa[0]);
+  ASSERT_EQ(2.0, fa[1]);
+  ASSERT_EQ(-3.0, fa[2]);
+  ASSERT_EQ(0.0, fa[3]);
+  ASSERT_THROW(fa::npy::MappedArray mapped(file.path), fa::io::io_error);
+
+  // little-endian int16, shape as written by Python 2
+  write_bytes(file.path, npy_image(
+      "{'descr': '<i2', 'fortran_order': False, 'shape': (3L,), }",
+      std::string("\x01\x00\xff\xff\x00\x80", 6)));
+  fa::npy::load(file.path, &fa);
+  ASSERT_EQ(3, fa.size());
+  ASSERT_EQ(1.0, fa[0]);
+  ASSERT_EQ(-1.0, fa[1]);
+  ASSERT_EQ(-32768.0, fa[2]);
+
+  // unsupported dtype and truncated data
+  write_bytes(file.path, npy_image(
+      "{'descr': '<c16', 'fortran_order': False, 'shape': (1,), }",
+      std::string(16, '\0')));
+  ASSERT_THROW(fa::npy::load(file.path, &fa), fa::io::io_error);
+  write_bytes(file.path, npy_image(
+      "{'descr': '<f8', 'fortran_order': False, 'shape': (4,), }",
+      std::string(16, '\0')));
+  ASSERT_THROW(fa::npy::load(file.path, &fa), fa::io::io_error);
+
+  // a shape whose element count overflows uint64_t
+  write_bytes(file.path, npy_image(
+      "{'descr': '<f8', 'fortran_order': False, "
+      "'shape': (4294967296, 4294967296, 2), }",
+      std::string(16, '\0')));
+  ASSERT_THROW(fa::npy::load(file.path, &fa), fa::io::io_error);
+
+  // a writer that is not closed leaves no file behind
+  {
+    fa::npy::Writer writer(file.path);
+    writer.write(fa);
+  }
+  ASSERT_NE(0, access(file.path.c_str(), F_OK));
+}
+
+TEST(Npz, write_and_read)
+{
+  fa::FastArray fa(1000, 1.5);
+  fa::FastArray fb(3, -2.0);
+  fa::FastArray empty;
+  TempFile file;
+  {
+    fa::npz::Writer writer(file.path);
+    writer.add("pressure", fa);
+    writer.add("v", fb);
+    writer.add("empty", empty);
+    writer.close();
+  }
+  const fa::npz::Archive archive(file.path);
+  const std::vector<std::string> names = archive.names();
+  ASSERT_EQ(3u, names.size());
+  ASSERT_TRUE(archive.contains("pressure"));
+  ASSERT_FALSE(archive.contains("pressure.npy"));
+
+  const fa::FastArrayView pressure = archive.view("pressure");
+  ASSERT_EQ(1000, pressure.size());
+  ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(pressure.data()) % 64);
+  fa::FastArray fc(1000);
+  fc = pressure * 2.0;
+  ASSERT_EQ(3.0, fc[999]);
+
+  archive.load("v", &fc);
+  ASSERT_EQ(3, fc.size());
+  ASSERT_EQ(-2.0, fc[2]);
+  ASSERT_EQ(0, archive.view("empty").size());
+  ASSERT_THROW(archive.view("missing"), fa::io::io_error);
+}
+
+namespace {
+
+std::string read_bytes(const std::string& path) {
+  std::string bytes;
+  FILE* f = std::fopen(path.c_str(), "rb");
+  for(int c; (c = std::fgetc(f)) != EOF; )
+    bytes.push_back(static_cast<char>(c));
+  std::fclose(f);
+  return bytes;
+}
+
+void put_u16(std::string* bytes, size_t at, unsigned v) {
+  (*bytes)[at] = static_cast<char>(v & 0xff);
+  (*bytes)[at + 1] = static_cast<char>(v >> 8);
+}
+
+}  // namespace
+
+TEST(Npz, corrupt_archives)
+{
+  fa::FastArray fa(10, 1.0);
+  TempFile file;
+  {
+    fa::npz::Writer writer(file.path);
+    writer.add("a", fa);
+    writer.close();
+  }
+  const std::string good = read_bytes(file.path);
+  const size_t central = good.find(std::string("PK\x01\x02", 4));
+  ASSERT_NE(std::string::npos, central);
+
+  // name running past the end of the file
+  std::string bad = good;
+  put_u16(&bad, central + 28, 0xffff);
+  write_bytes(file.path, bad);
+  ASSERT_THROW(fa::npz::Archive archive(file.path), fa::io::io_error);
+
+  // extra field running past the end of the file
+  bad = good;
+  put_u16(&bad, central + 30, 0xffff);
+  write_bytes(file.path, bad);
+  ASSERT_THROW(fa::npz::Archive archive(file.path), fa::io::io_error);
+
+  // local header offset past the end of the file
+  bad = good;
+  put_u16(&bad, central + 42, 0xfff0);
+  put_u16(&bad, central + 44, 0x7fff);
+  write_bytes(file.path, bad);
+  ASSERT_THROW(fa::npz::Archive archive(file.path), fa::io::io_error);
+
+  // member data running past the end of the file
+  bad = good;
+  put_u16(&bad, central + 20, 0xfff0);
+  put_u16(&bad, central + 24, 0xfff0);
+  write_bytes(file.path, bad);
+  ASSERT_THROW(fa::npz::Archive archive(file.path), fa::io::io_error);
+
+  // a writer that is not closed leaves no file behind
+  {
+    fa::npz::Writer writer(file.path);
+    writer.add("a", fa);
+  }
+  ASSERT_NE(0, access(file.path.c_str(), F_OK));
+}
+
+TEST(OutOfCore, chunked_evaluation)
+{
+  // not a multiple of the chunk, so the last chunk is partial
+  const fa::IndexT size = 10007;
+  const fa::IndexT chunk = 1000;
+  fa::FastArray fa(size), fb(size);
+  for(fa::IndexT i=0; i < size; ++i) {
+    fa[i] = i;
+    fb[i] = 0.5 * (size - i);
+  }
+  TempFile a, b, out;
+  fa::io::save(a.path, fa);
+  fa::npy::save(b.path, fb);
+
+  const fa::ooc::Input ia(a.path), ib(b.path);
+  ASSERT_EQ(size, ia.size());
+  ASSERT_EQ(size, ib.size());
+  fa::io::Writer writer(out.path);
+  const auto triad = [](const fa::FastArrayView& a,
+                        const fa::FastArrayView& b) {
+    return a + 2.0 * b;
+  };
+  fa::ooc::evaluate(&writer, chunk, triad, ia, ib);
+  writer.close();
+  ASSERT_EQ(static_cast<uint64_t>(size), writer.size());
+
+  // loading verifies the checksum accumulated chunk by chunk
+  fa::FastArray fc;
+  fa::io::load(out.path, &fc);
+  ASSERT_EQ(size, fc.size());
+  for(fa::IndexT i=0; i < size; ++i)
+    ASSERT_DOUBLE_EQ(static_cast<double>(size), fc[i]);
+
+  // a single input, whole in one chunk, to .npy
+  fa::npy::Writer npy_writer(out.path);
+  fa::ooc::evaluate(&npy_writer, fa::ooc::DEFAULT_CHUNK,
+                    [](const fa::FastArrayView& a) { return sqrt(a); }, ia);
+  npy_writer.close();
+  fa::npy::load(out.path, &fc);
+  ASSERT_EQ(size, fc.size());
+  ASSERT_DOUBLE_EQ(100.0, fc[10000]);
+}
+
+TEST(OutOfCore, errors)
+{
+  fa::FastArray fa(100, 1.0), fb(99, 1.0);
+  TempFile a, b, out;
+  fa::io::save(a.path, fa);
+  fa::io::save(b.path, fb);
+  const fa::ooc::Input ia(a.path), ib(b.path);
+  fa::io::Writer writer(out.path);
+  const auto sum = [](const fa::FastArrayView& a, const fa::FastArrayView& b) {
+    return a + b;
+  };
+  ASSERT_THROW(fa::ooc::evaluate(&writer, 10, sum, ia, ib), std::length_error);
+  ASSERT_THROW(fa::ooc::evaluate(&writer, 0, sum, ia, ia),
+               std::invalid_argument);
+  ASSERT_EQ(0u, writer.size());
+  ASSERT_THROW(fa::ooc::Input(out.path + ".missing"), fa::io::io_error);
+}
+
+TEST(Codec, shuffle)
+{
+  // 16-word groups take the vector path, the rest the scalar path
+  const size_t n = 37;
+  std::vector<uint64_t> words(n);
+  unsigned char* bytes = reinterpret_cast<unsigned char*>(&words[0]);
+  for(size_t k=0; k < 8 * n; ++k)
+    bytes[k] = static_cast<unsigned char>(k * 7 + 3);
+  std::vector<unsigned char> planes(8 * n);
+  fa::codec::shuffle(&words[0], n, &planes[0]);
+  for(size_t i=0; i < n; ++i)
+    for(size_t j=0; j < 8; ++j)
+      ASSERT_EQ(bytes[8 * i + j], planes[j * n + i]);
+
+  std::vector<uint64_t> back(n);
+  fa::codec::unshuffle(&planes[0], n, &back[0]);
+  ASSERT_TRUE(back == words);
+}
+
+TEST(Codec, lossless_round_trip)
+{
+  const fa::IndexT sizes[] = { 0, 1, 17, fa::codec::BLOCK_ELEMENTS + 5 };
+  for(size_t k=0; k < sizeof(sizes) / sizeof(sizes[0]); ++k) {
+    const fa::IndexT size = sizes[k];
+    fa::FastArray fa(size);
+    for(fa::IndexT i=0; i < size; ++i)
+      fa[i] = i % 1000 < 500 ? 1.0 + 1e-3 * i : std::sin(i * 12.9898);
+    if (size > 4) {
+      fa[1] = -0.0;
+      fa[2] = std::numeric_limits<double>::quiet_NaN();
+      fa[3] = -std::numeric_limits<double>::infinity();
+      fa[4] = std::numeric_limits<double>::denorm_min();
+    }
+    std::vector<char> encoded;
+    fa::codec::encode(fa, &encoded);
+    ASSERT_EQ(static_cast<uint64_t>(size),
+              fa::codec::decoded_size(&encoded[0], encoded.size()));
+    fa::FastArray fb(size);
+    fa::codec::decode(&encoded[0], encoded.size(), fb.data());
+    ASSERT_EQ(0, std::memcmp(fa.data(), fb.data(),
+                             size * sizeof(fa::ScalarT)));
+  }
+}
+
+TEST(Codec, compresses_smooth_fields)
+{
+  const fa::IndexT size = 100000;
+  fa::FastArray smooth(size), flat(size, 101325.0);
+  for(fa::IndexT i=0; i < size; ++i)
+    smooth[i] = 300.0 + 20.0 * std::sin(1e-4 * i);
+  std::vector<char> encoded;
+  fa::codec::encode(smooth, &encoded);
+  ASSERT_LT(encoded.size(), 0.75 * size * sizeof(fa::ScalarT));
+  encoded.clear();
+  fa::codec::encode(flat, &encoded);
+  ASSERT_LT(encoded.size(), 0.01 * size * sizeof(fa::ScalarT));
+}
+
+TEST(Codec, detects_corruption)
+{
+  fa::FastArray fa(5000);
+  for(fa::IndexT i=0; i < fa.size(); ++i)
+    fa[i] = std::sqrt(i);
+  std::vector<char> encoded;
+  fa::codec::encode(fa, &encoded);
+  fa::FastArray fb(fa.size());
+  // truncated, and a bad plane length
+  ASSERT_THROW(fa::codec::decode(&encoded[0], encoded.size() - 1, fb.data()),
+               fa::io::io_error);
+  std::vector<char> bad(encoded);
+  bad[4 * sizeof(uint64_t) + 1] ^= 0x40;
+  ASSERT_THROW(fa::codec::decode(&bad[0], bad.size(), fb.data()),
+               fa::io::io_error);
+}
+
+TEST(IO, save_load_encoded)
+{
+  const fa::IndexT size = 40000;
+  fa::FastArray fa(size);
+  for(fa::IndexT i=0; i < size; ++i)
+    fa[i] = 1.0 + std::cos(1e-3 * i);
+  TempFile file;
+  fa::io::save(file.path, fa, fa::io::CODEC_LOSSLESS);
+
+  const fa::io::Header h = fa::io::read_header(file.path);
+  ASSERT_EQ(static_cast<uint32_t>(fa::io::CODEC_LOSSLESS), h.codec);
+  ASSERT_EQ(static_cast<uint64_t>(size), h.size);
+  ASSERT_LT(h.encoded_bytes, size * sizeof(fa::ScalarT));
+
+  fa::FastArray fb;
+  fa::io::load(file.path, &fb);
+  ASSERT_EQ(size, fb.size());
+  ASSERT_EQ(0, std::memcmp(fa.data(), fb.data(), size * sizeof(fa::ScalarT)));
+  ASSERT_THROW(fa::io::MappedArray mapped(file.path), fa::io::io_error);
+}
+
+TEST(IO, failed_encoded_save_leaves_no_file)
+{
+  const fa::IndexT size = 40000;
+  fa::FastArray fa(size);
+  for(fa::IndexT i=0; i < size; ++i)
+    fa[i] = 1e6 * std::sin(i * 12.9898);
+  TempFile file;
+
+  // a file size limit makes the write fail part way, in a child so
+  // that the limit does not outlive the test
+  const pid_t child = fork();
+  if (child == 0) {
+    std::signal(SIGXFSZ, SIG_IGN);
+    struct rlimit limit;
+    limit.rlim_cur = limit.rlim_max = 4096;
+    setrlimit(RLIMIT_FSIZE, &limit);
+    bool failed = false;
+    try {
+      fa::io::save(file.path, fa, fa::io::CODEC_LOSSLESS);
+    } catch (const fa::io::io_error&) {
+      failed = true;
+    }
+    _exit(failed && access(file.path.c_str(), F_OK) != 0 ? 0 : 1);
+  }
+  int status = -1;
+  ASSERT_EQ(child, waitpid(child, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(0, WEXITSTATUS(status));
+}
+
+TEST(Codec, bounded_round_trip)
+{
+  const fa::IndexT size = fa::codec::BLOCK_ELEMENTS + 1000;
+  fa::FastArray fa(size), fb(size);
+  for(fa::IndexT i=0; i < size; ++i)
+    fa[i] = i % 3000 < 2000 ? 300.0 + 20.0 * std::sin(1e-3 * i)
+                            : 1e6 * std::sin(i * 12.9898);
+  fa[10] = std::numeric_limits<double>::quiet_NaN();
+  fa[11] = std::numeric_limits<double>::infinity();
+  fa[12] = 1e300;
+  fa[13] = -1e300;
+  const double bounds[] = { 1e-12, 1e-3, 0.5, 1e3 };
+  for(size_t k=0; k < sizeof(bounds) / sizeof(bounds[0]); ++k) {
+    std::vector<char> encoded;
+    fa::codec::encode_bounded(fa, bounds[k], &encoded);
+    ASSERT_EQ(bounds[k], fa::codec::error_bound(&encoded[0], encoded.size()));
+    fa::codec::decode_bounded(&encoded[0], encoded.size(), fb.data());
+    ASSERT_TRUE(std::isnan(fb[10]));
+    ASSERT_EQ(fa[11], fb[11]);
+    for(fa::IndexT i=0; i < size; ++i) {
+      if(i != 10 && i != 11) {
+        ASSERT_LT(std::fabs(fa[i] - fb[i]), bounds[k]);
+      }
+    }
+  }
+  std::vector<char> encoded;
+  ASSERT_THROW(fa::codec::encode_bounded(fa, 0.0, &encoded),
+               std::invalid_argument);
+}
+
+TEST(Codec, bounded_compresses_smooth_fields)
+{
+  const fa::IndexT size = 100000;
+  fa::FastArray fa(size);
+  for(fa::IndexT i=0; i < size; ++i)
+    fa[i] = 300.0 + 20.0 * std::sin(1e-4 * i);
+  std::vector<char> encoded;
+  fa::codec::encode_bounded(fa, 1e-3, &encoded);
+  // an order of magnitude, where lossless coding saves about a third
+  ASSERT_LT(encoded.size(), 0.1 * size * sizeof(fa::ScalarT));
+
+  std::vector<char> bad(encoded);
+  bad.resize(bad.size() - 1);
+  fa::FastArray fb(size);
+  ASSERT_THROW(fa::codec::decode_bounded(&bad[0], bad.size(), fb.data()),
+               fa::io::io_error);
+}
+
+TEST(IO, save_load_bounded)
+{
+  const fa::IndexT size = 40000;
+  fa::FastArray fa(size);
+  for(fa::IndexT i=0; i < size; ++i)
+    fa[i] = 1.0 + std::cos(1e-3 * i);
+  TempFile file;
+  ASSERT_THROW(fa::io::save(file.path, fa, fa::io::CODEC_BOUNDED),
+               fa::io::io_error);
+  fa::io::save(file.path, fa, fa::io::CODEC_BOUNDED, 1e-6);
+  const fa::io::Header h = fa::io::read_header(file.path);
+  ASSERT_EQ(static_cast<uint32_t>(fa::io::CODEC_BOUNDED), h.codec);
+  ASSERT_LT(h.encoded_bytes, size * sizeof(fa::ScalarT) / 2);
+
+  // load() verifies the checksum of the decoded data
+  fa::FastArray fb;
+  fa::io::load(file.path, &fb);
+  ASSERT_EQ(size, fb.size());
+  for(fa::IndexT i=0; i < size; ++i)
+    ASSERT_LT(std::fabs(fa[i] - fb[i]), 1e-6);
+}
+
+namespace {
+
+// An allocator recording what it hands out
+class counting_allocator : public fa::Allocator {
+ public:
+  counting_allocator() : allocated(0), live(0) {}
+  fa::ScalarT* allocate(const fa::IndexT n) {
+    ++allocated;
+    live += n;
+    return new fa::ScalarT[n];
+  }
+  void deallocate(fa::ScalarT* p, const fa::IndexT n) {
+    live -= n;
+    delete[] p;
+  }
+  int allocated;
+  fa::IndexT live;
+};
+
+std::string shm_name(const char* what) {
+  return std::string("/fa-unit-test-").append(what).append("-")
+      .append(std::to_string(getpid()));
+}
+
+}  // namespace
+
+TEST(Allocator, custom_allocator)
+{
+  counting_allocator allocator;
+  {
+    fa::FastArray fa(100, &allocator);
+    ASSERT_EQ(&allocator, fa.allocator());
+    ASSERT_EQ(1, allocator.allocated);
+    ASSERT_EQ(100, allocator.live);
+    fa.resize(50);
+    fa.resize(200);
+    ASSERT_EQ(2, allocator.allocated);
+    ASSERT_EQ(200, allocator.live);
+
+    // copies are private, assignment keeps the target's allocator
+    fa = 1.0;
+    const fa::FastArray fb(fa);
+    ASSERT_EQ(fa::default_allocator(), fb.allocator());
+    fa::FastArray fc(&allocator);
+    fc = fb;
+    ASSERT_EQ(&allocator, fc.allocator());
+    ASSERT_EQ(400, allocator.live);
+    ASSERT_EQ(1.0, fc[199]);
+  }
+  ASSERT_EQ(0, allocator.live);
+}
+
+TEST(Arena, stack_like_reuse)
+{
+  fa::Arena arena(1 << 16);
+  ASSERT_EQ(0u, arena.used());
+  for (int step = 0; step < 3; ++step) {
+    fa::FastArray fa(100, &arena), fb(100, &arena);
+    ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(fa.data()) % 64);
+    ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(fb.data()) % 64);
+    fa = 2.0;
+    fb = fa * fa;
+    ASSERT_EQ(4.0, fb[99]);
+  }
+  // every step reused the first step's memory
+  ASSERT_EQ(0u, arena.used());
+  const size_t high_water = arena.high_water();
+  ASSERT_GT(high_water, 2 * 100 * sizeof(fa::ScalarT));
+
+  // out-of-order release is reclaimed with what came after it
+  fa::FastArray* first = new fa::FastArray(100, &arena);
+  fa::FastArray* second = new fa::FastArray(100, &arena);
+  delete first;
+  ASSERT_EQ(high_water, arena.used());
+  delete second;
+  ASSERT_EQ(0u, arena.used());
+  ASSERT_EQ(high_water, arena.high_water());
+
+  ASSERT_THROW(fa::FastArray(1 << 16, &arena), std::bad_alloc);
+  ASSERT_EQ(0u, arena.used());
+}
+
+TEST(Pool, recycles_buffers)
+{
+  fa::pool::trim();
+  fa::pool::reset_stats();
+  fa::Allocator* const previous = fa::default_allocator();
+  fa::set_default_allocator(fa::pool::allocator());
+  for (int step = 0; step < 4; ++step) {
+    fa::FastArray fa(1000), fb(1000);
+    ASSERT_EQ(fa::pool::allocator(), fa.allocator());
+    ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(fa.data()) % 64);
+    fa = 1.0;
+    fb = fa + fa;
+    ASSERT_EQ(2.0, fb[999]);
+  }
+  fa::set_default_allocator(previous);
+
+  // the first step missed, the rest reused its two buffers
+  fa::pool::Stats stats = fa::pool::stats();
+  ASSERT_EQ(2u, stats.misses);
+  ASSERT_EQ(6u, stats.hits);
+  ASSERT_DOUBLE_EQ(0.75, stats.hit_rate());
+  ASSERT_EQ(2u, stats.retained_buffers);
+  ASSERT_EQ(2u * 8192, stats.retained_bytes);
+
+  // sizes in the same power-of-two class share buffers
+  {
+    fa::FastArray fc(700, fa::pool::allocator());
+  }
+  ASSERT_EQ(7u, fa::pool::stats().hits);
+
+  fa::pool::trim(8192);
+  ASSERT_EQ(1u, fa::pool::stats().retained_buffers);
+  fa::pool::trim();
+  ASSERT_EQ(0u, fa::pool::stats().retained_bytes);
+
+  // beyond the retain limit buffers go back to the heap
+  const size_t limit = fa::pool::retain_limit();
+  fa::pool::set_retain_limit(4096);
+  {
+    fa::FastArray fd(1000, fa::pool::allocator());
+  }
+  ASSERT_EQ(0u, fa::pool::stats().retained_buffers);
+  fa::pool::set_retain_limit(limit);
+}
+
+TEST(NumaAllocator, first_touch)
+{
+  fa::NumaAllocator numa;
+  const fa::IndexT n = 3 * (1 << 18) + 5;
+  ASSERT_TRUE(fa::NumaAllocator::is_mapped(n));
+  {
+    fa::FastArray fa(n, &numa);
+    const uintptr_t address = reinterpret_cast<uintptr_t>(fa.data());
+    ASSERT_EQ(0u, address % fa::NumaAllocator::HUGE_PAGE_BYTES);
+    // every page was touched before the array was handed out
+    const size_t page = ::sysconf(_SC_PAGESIZE);
+    const size_t bytes = n * sizeof(fa::ScalarT);
+    std::vector<unsigned char> resident((bytes + page - 1) / page);
+    ASSERT_EQ(0, ::mincore(fa.data(), bytes, &resident[0]));
+    for (size_t i = 0; i < resident.size(); ++i)
+      ASSERT_TRUE(resident[i] & 1) << "page " << i;
+
+    fa::FastArray fb(n, &numa);
+    fa = 2.0;
+    fa::parallel(fb) = fa * fa + 1.0;
+    ASSERT_EQ(5.0, fb[0]);
+    ASSERT_EQ(5.0, fb[n - 1]);
+  }
+
+  // small arrays come from new[]
+  ASSERT_FALSE(fa::NumaAllocator::is_mapped(1000));
+  fa::FastArray small(1000, &numa);
+  small = 1.0;
+  small.resize(n);
+  small = 3.0;
+  ASSERT_EQ(3.0, small[n - 1]);
+}
+
+TEST(CopyOnWrite, copies_share_until_written)
+{
+  counting_allocator backing;
+  fa::cow::Allocator cow(&backing);
+  {
+    fa::FastArray fa(1000, &cow);
+    fa = 1.0;
+    const fa::FastArray fb(fa);
+    ASSERT_EQ(&cow, fb.allocator());
+    ASSERT_EQ(fb.data(), static_cast<const fa::FastArray&>(fa).data());
+    ASSERT_TRUE(fa.shared());
+    ASSERT_EQ(2, cow.references(fb.data()));
+    ASSERT_EQ(1, backing.allocated);
+
+    // a write through either gives the writer its own buffer
+    fa[0] = 2.0;
+    ASSERT_FALSE(fa.shared());
+    ASSERT_FALSE(fb.shared());
+    ASSERT_EQ(2, backing.allocated);
+    ASSERT_EQ(2.0, fa[0]);
+    ASSERT_EQ(1.0, fb[0]);
+    ASSERT_EQ(1.0, fa[999]);
+
+    // assignment between arrays of one allocator shares too
+    fa::FastArray fc(&cow);
+    fc = fb;
+    ASSERT_EQ(fb.data(), static_cast<const fa::FastArray&>(fc).data());
+    ASSERT_EQ(2, backing.allocated);
+
+    // expressions reading the shared buffer still see it
+    fc = fc * 3.0;
+    ASSERT_EQ(3.0, fc[999]);
+    ASSERT_EQ(1.0, fb[999]);
+    ASSERT_EQ(3, backing.allocated);
+
+    fa::FastArray fd(fb);
+    fa::parallel(fd) = fd + fa;
+    ASSERT_FALSE(fb.shared());
+    ASSERT_EQ(3.0, fd[0]);
+    ASSERT_EQ(2.0, fd[999]);
+    ASSERT_EQ(1.0, fb[0]);
+
+    // arrays of other allocators copy as before
+    const fa::FastArray fe(fa::FastArray(10, 4.0));
+    ASSERT_EQ(fa::default_allocator(), fe.allocator());
+  }
+  ASSERT_EQ(0, backing.live);
+}
+
+TEST(SharedMemory, write_and_read)
+{
+  const std::string name = shm_name("rw");
+  fa::shm::Allocator shared(name);
+  fa::FastArray fa(1000, &shared);
+  {
+    fa::shm::WriteScope write(shared);
+    fa = 2.0;
+  }
+  ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(fa.data()) % 64);
+  // the name is taken while the array lives
+  fa::shm::Allocator second(name);
+  ASSERT_THROW(second.allocate(1), fa::io::io_error);
+
+  fa::shm::Reader reader(name);
+  ASSERT_EQ(1000, reader.capacity());
+  const uint64_t version = reader.begin_read();
+  fa::FastArray fb(1000);
+  fb = reader.view() * 3.0;
+  ASSERT_TRUE(reader.validate(version));
+  ASSERT_EQ(6.0, fb[999]);
+
+  // a write since begin_read() invalidates what was read
+  shared.begin_write();
+  fa[0] = 5.0;
+  shared.end_write();
+  ASSERT_FALSE(reader.validate(version));
+  reader.snapshot(&fb);
+  ASSERT_EQ(5.0, fb[0]);
+
+  // another process sees the same memory
+  const pid_t child = fork();
+  if (child == 0) {
+    fa::shm::Reader other(name);
+    fa::FastArray copy;
+    other.snapshot(&copy);
+    _exit(copy.size() == 1000 && copy[0] == 5.0 && copy[1] == 2.0 ? 0 : 1);
+  }
+  int status = -1;
+  ASSERT_EQ(child, waitpid(child, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(0, WEXITSTATUS(status));
+
+  // growing moves the array; readers of the old one see it retired
+  ASSERT_FALSE(reader.retired());
+  fa.resize(2000);
+  ASSERT_TRUE(reader.retired());
+  ASSERT_EQ(2000, fa::shm::Reader(name).capacity());
+}
+
+TEST(SharedMemory, unlinked_with_the_array)
+{
+  const std::string name = shm_name("unlink");
+  {
+    fa::shm::Allocator shared(name);
+    fa::FastArray fa(10, &shared);
+  }
+  ASSERT_THROW(fa::shm::Reader reader(name), fa::io::io_error);
+
+  // a name left behind is removed explicitly
+  fa::shm::Allocator shared(name);
+  shared.allocate(10);
+  fa::shm::Allocator next(name);
+  ASSERT_THROW(next.allocate(10), fa::io::io_error);
+  fa::shm::remove(name);
+  fa::shm::remove(name);
+  fa::FastArray fa(10, &next);
+  ASSERT_EQ(10, fa::shm::Reader(name).capacity());
+}
@@ -0,0 +1,36 @@
+// Copyright 2011 Patrick K. Notz
+//
+// Representative expression shapes assigned through FastArray's own
+// operators, so that everything between an assignment and its loop
+// -- the copy-on-write check, the aliasing test and the streaming
+// threshold -- is compiled into the checked code. Each kernel is an
+// unmangled, out-of-line function so that check-vectorization.sh can
+// find it in the object code and assert that the loop an assignment
+// reaches with cached stores uses packed vector instructions. Keep
+// the kernels to shapes the compiler is expected to vectorize;
+// library calls such as exp() or pow() have no packed form without a
+// vector math library and do not belong here.
+//
+#include <FastArray.hpp>
+
+#define FA_VECTORIZATION_KERNEL(NAME, ASSIGNMENT)                       \
+  extern "C" __attribute__((noinline))                                  \
+  void fa_vec_##NAME(fa::FastArray& u, const fa::FastArray& a,          \
+                     const fa::FastArray& b, const fa::FastArray& c,    \
+                     const fa::ScalarT s) {                             \
+    (void) a; (void) b; (void) c; (void) s;                             \
+    ASSIGNMENT;                                                         \
+  }
+
+FA_VECTORIZATION_KERNEL(add, u = a + b)
+FA_VECTORIZATION_KERNEL(subtract, u = a - b)
+FA_VECTORIZATION_KERNEL(multiply, u = a * b)
+FA_VECTORIZATION_KERNEL(divide, u = a / b)
+FA_VECTORIZATION_KERNEL(scale, u = s * a)
+FA_VECTORIZATION_KERNEL(triad, u = b + s * c)
+FA_VECTORIZATION_KERNEL(composite, u = (a + b) * c - a / s)
+FA_VECTORIZATION_KERNEL(unary_minus, u = -(a * b))
+FA_VECTORIZATION_KERNEL(fabs, u = fabs(a - b))
+FA_VECTORIZATION_KERNEL(max, u = max(a, b) + min(b, c))
+FA_VECTORIZATION_KERNEL(plus_assign, u += a * b)
+FA_VECTORIZATION_KERNEL(multiply_assign, u *= a + s)